@@ -4,15 +4,44 @@
 			"target_name": "prussdrv",
 			"sources": [
 				"src/prussdrv.cpp",
+				"src/memory.cpp",
+				"src/interrupts.cpp",
+				"src/ring.cpp",
+				"src/ringbuffer.cpp",
+				"src/batch.cpp",
+				"src/loader.cpp",
+				"src/imagecache.cpp",
+				"src/stats.cpp",
+				"src/handlers.cpp",
+				"src/blockstream.cpp",
+				"src/profiler.cpp",
+				"src/control.cpp",
+				"src/seqlock.cpp",
+				"src/watch.cpp",
+				"src/session.cpp",
+				"src/context.cpp",
 				"prussdrv/prussdrv.c",
+				"prussdrv/pruss_copy.c",
 			],
 			"include_dirs": [
 				"prussdrv",
+				"firmware",
 				"<!(node -e \"require('nan')\")"
 			],
+			"libraries": [
+				"-ldl"
+			],
 			"cflags": [
 				"-std=c++11",
 				"-fpermissive" 
+			],
+			"conditions": [
+				# armhf toolchains default to VFP only, pruss_copy.c needs NEON for burst copies
+				[ "target_arch=='arm'", {
+					"cflags": [
+						"-mfpu=neon"
+					]
+				} ]
 			]
 		}
 	]
@@ -0,0 +1,87 @@
+/*
+ * pru_ring.h
+ *
+ * Single-producer/single-consumer ring buffer shared between the PRU and the host.
+ * This header is used by both sides: PRU firmware built with clpru, and the Node.js addon.
+ *
+ * Layout, at any 4 byte aligned offset in data RAM, shared RAM or DDR:
+ *
+ *	offset 0	head		free-running count of elements written, only the producer writes it
+ *	offset 4	tail		free-running count of elements read, only the consumer writes it
+ *	offset 8	capacity	number of element slots, a power of two
+ *	offset 12	elem_size	bytes per element, a multiple of 4
+ *	offset 16	data		capacity * elem_size bytes
+ *
+ * Element n lives in slot (n & (capacity - 1)). The ring holds (head - tail) elements,
+ * with unsigned 32 bit wrap-around, and is full when that equals capacity.
+ * The producer writes the element before it publishes the new head, the consumer copies
+ * the element out before it publishes the new tail.
+ */
+
+#ifndef _PRU_RING_H
+#define _PRU_RING_H
+
+#include <stdint.h>
+
+#define PRU_RING_HEAD			0
+#define PRU_RING_TAIL			4
+#define PRU_RING_CAPACITY		8
+#define PRU_RING_ELEM_SIZE		12
+#define PRU_RING_DATA			16
+#define PRU_RING_HEADER_SIZE	16
+
+struct pru_ring {
+	volatile uint32_t head;
+	volatile uint32_t tail;
+	uint32_t capacity;
+	uint32_t elem_size;
+};
+
+#define PRU_RING_DATA_PTR(ring) ((volatile uint8_t *) (ring) + PRU_RING_DATA)
+
+#if defined(__TI_PRU__)
+/* Append one element, returns 0 if the ring is full
+ *	The PRU executes loads and stores in order, so publishing the head after the
+ *	copy is enough for the host to never see a partially written element.
+ */
+static inline int pru_ring_push(volatile struct pru_ring *ring, const void *item)
+{
+	uint32_t head = ring->head;
+	uint32_t i;
+	volatile uint32_t *dst;
+	const uint32_t *src = (const uint32_t *) item;
+
+	if (head - ring->tail >= ring->capacity)
+		return 0;
+
+	dst = (volatile uint32_t *) (PRU_RING_DATA_PTR(ring) +
+		(head & (ring->capacity - 1)) * ring->elem_size);
+	for (i = 0; i < ring->elem_size / 4; i++)
+		dst[i] = src[i];
+
+	ring->head = head + 1;
+	return 1;
+}
+
+/* Remove one element, returns 0 if the ring is empty */
+static inline int pru_ring_pop(volatile struct pru_ring *ring, void *item)
+{
+	uint32_t tail = ring->tail;
+	uint32_t i;
+	volatile uint32_t *src;
+	uint32_t *dst = (uint32_t *) item;
+
+	if (ring->head == tail)
+		return 0;
+
+	src = (volatile uint32_t *) (PRU_RING_DATA_PTR(ring) +
+		(tail & (ring->capacity - 1)) * ring->elem_size);
+	for (i = 0; i < ring->elem_size / 4; i++)
+		dst[i] = src[i];
+
+	ring->tail = tail + 1;
+	return 1;
+}
+#endif
+
+#endif
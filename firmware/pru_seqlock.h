@@ -0,0 +1,42 @@
+/*
+ * pru_seqlock.h
+ *
+ * Sequence lock letting the host copy a multi-word record the PRU keeps updating,
+ * without tearing and without stopping the PRU. There is one writer, the PRU.
+ * This header is used by both sides: PRU firmware built with clpru, and the Node.js addon.
+ *
+ * Layout, at any 4 byte aligned offset in data RAM, shared RAM or DDR:
+ *
+ *	offset 0	seq		even while the record is stable, odd while the PRU is writing it
+ *	offset 4	data	the record
+ *
+ * The PRU increments seq before and after each update. The host reads seq, copies the
+ * record and reads seq again. The copy is consistent if both reads returned the same
+ * even value, otherwise it starts over.
+ */
+
+#ifndef _PRU_SEQLOCK_H
+#define _PRU_SEQLOCK_H
+
+#include <stdint.h>
+
+#define PRU_SEQLOCK_SEQ			0
+#define PRU_SEQLOCK_DATA		4
+#define PRU_SEQLOCK_HEADER_SIZE	4
+
+#if defined(__TI_PRU__)
+/* Bracket an update of the record, the PRU executes loads and stores in order
+ * so nothing more than the increments is needed
+ */
+static inline void pru_seqlock_write_begin(volatile uint32_t *seq)
+{
+	*seq = *seq + 1;
+}
+
+static inline void pru_seqlock_write_end(volatile uint32_t *seq)
+{
+	*seq = *seq + 1;
+}
+#endif
+
+#endif
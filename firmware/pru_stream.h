@@ -0,0 +1,69 @@
+/*
+ * pru_stream.h
+ *
+ * Block stream from the PRU to the host, for captures too big for a ring of small elements.
+ * The PRU fills fixed-size blocks in a data area, typically the DDR external memory, and
+ * the host hands each full block to JS. With two blocks this is plain ping-pong buffering.
+ * This header is used by both sides: PRU firmware built with clpru, and the Node.js addon.
+ *
+ * Control header, at any 4 byte aligned offset in data RAM, shared RAM or DDR:
+ *
+ *	offset 0	filled		free-running count of blocks filled, only the PRU writes it
+ *	offset 4	released	free-running count of blocks handed back, only the host writes it
+ *	offset 8	block_count	number of blocks in the data area, a power of two
+ *	offset 12	block_size	bytes per block, a multiple of 4
+ *	offset 16	data_addr	physical address of block 0, as seen by the PRU
+ *	offset 20	flags		written by the host, see PRU_STREAM_FLAG_*
+ *
+ * Block n lives at data_addr + (n & (block_count - 1)) * block_size. The PRU may fill block n
+ * once n - released < block_count, and raises its host interrupt after publishing filled.
+ */
+
+#ifndef _PRU_STREAM_H
+#define _PRU_STREAM_H
+
+#include <stdint.h>
+
+#define PRU_STREAM_FILLED		0
+#define PRU_STREAM_RELEASED		4
+#define PRU_STREAM_BLOCK_COUNT	8
+#define PRU_STREAM_BLOCK_SIZE	12
+#define PRU_STREAM_DATA_ADDR	16
+#define PRU_STREAM_FLAGS		20
+#define PRU_STREAM_HEADER_SIZE	24
+
+//Set by the host while it is behind and holds every block, cleared once it catches up
+#define PRU_STREAM_FLAG_OVERFLOW	1
+
+struct pru_stream {
+	volatile uint32_t filled;
+	volatile uint32_t released;
+	uint32_t block_count;
+	uint32_t block_size;
+	uint32_t data_addr;
+	volatile uint32_t flags;
+};
+
+#if defined(__TI_PRU__)
+/* Address of the block to fill next, or 0 if the host still holds all of them */
+static inline volatile uint8_t *pru_stream_block(volatile struct pru_stream *stream)
+{
+	uint32_t filled = stream->filled;
+
+	if (filled - stream->released >= stream->block_count)
+		return 0;
+
+	return (volatile uint8_t *) (stream->data_addr +
+		(filled & (stream->block_count - 1)) * stream->block_size);
+}
+
+/* Hand the block returned by pru_stream_block() to the host
+ *	Raise the host interrupt after this, e.g. __R31 = 32 | (PRU0_ARM_INTERRUPT - 16).
+ */
+static inline void pru_stream_publish(volatile struct pru_stream *stream)
+{
+	stream->filled = stream->filled + 1;
+}
+#endif
+
+#endif
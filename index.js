@@ -0,0 +1,623 @@
+'use strict';
+
+var Readable = require('stream').Readable;
+var Writable = require('stream').Writable;
+var util = require('util');
+
+// Everything the native binding exports is exported, this file adds the promise based
+// interrupt API, readBlocks() and the read and write streams on top of it, and wraps
+// onInterrupt(), offInterrupt() and exit() so they keep those in step.
+var pru = require('./build/Release/prussdrv');
+
+// Interrupts queued per host while nobody awaits them, older ones are dropped
+// and counted in the missed count of the next one
+var QUEUE_LIMIT = 1024;
+
+// Longest setTimeout delay, used to keep the process alive while a wait has no timeout
+var FOREVER = 0x7fffffff;
+
+// Chunks of a read stream are carved out of slabs of at least this many bytes
+var POOL_SIZE = 64 * 1024;
+
+// Offset of the flags word in a block stream header, see firmware/pru_stream.h
+var STREAM_FLAGS = 20;
+var STREAM_FLAG_OVERFLOW = 1;
+
+// How often a write stream looks for free slots when no interrupt tells it, in ms
+var RETRY_INTERVAL = 1;
+
+// Field types of command layouts: size in bytes and the Buffer method writing one
+var FIELD_TYPES = {
+	uint8: [1, 'writeUInt8'],
+	int8: [1, 'writeInt8'],
+	uint16: [2, 'writeUInt16LE'],
+	int16: [2, 'writeInt16LE'],
+	uint32: [4, 'writeUInt32LE'],
+	int32: [4, 'writeInt32LE'],
+	float: [4, 'writeFloatLE']
+};
+
+var nativeOnInterrupt = pru.onInterrupt;
+var nativeOffInterrupt = pru.offInterrupt;
+var nativeExit = pru.exit;
+
+var subscriptions = [];
+
+// Owner of the callback subscription of each host made through pru.onInterrupt(),
+// so a stream can refuse a host in use and only ever cancel its own subscription
+var claims = [];
+
+function noop() {}
+
+/* Persistent native subscription to one host interrupt, shared by nextInterrupt() and interrupts()
+ *	The native watcher clears the system event itself when autoClear is set, so each
+ *	interrupt costs one native to JS call and no JS to native call. The watcher does
+ *	not hold the process open, pending waits do.
+ */
+function Subscription(host, autoClear) {
+	var self = this;
+	var options = { ref: false };
+
+	if (autoClear !== undefined) {
+		options.autoClear = autoClear;
+	}
+
+	this.host = host;
+	this.autoClear = autoClear;
+	this.queue = [];
+	this.waiters = [];
+	this.error = null;
+
+	nativeOnInterrupt(host, options, function(err, count, missed) {
+		if (err) {
+			self.close(err);
+		} else {
+			self.push({ host: host, count: count, missed: missed });
+		}
+	});
+}
+
+Subscription.prototype.push = function(event) {
+	var waiter = this.waiters.shift();
+	if (waiter) {
+		clearTimeout(waiter.timer);
+		return waiter.resolve(event);
+	}
+
+	if (this.queue.length >= QUEUE_LIMIT) {
+		var dropped = this.queue.shift();
+		this.queue[0].missed += dropped.missed + 1;
+	}
+	this.queue.push(event);
+};
+
+Subscription.prototype.next = function(timeout) {
+	var self = this;
+
+	if (this.queue.length > 0) {
+		return Promise.resolve(this.queue.shift());
+	}
+	if (this.error) {
+		return Promise.reject(this.error);
+	}
+
+	return new Promise(function(resolve, reject) {
+		var waiter = { resolve: resolve, reject: reject, timer: null };
+
+		if (timeout === undefined) {
+			waiter.timer = setTimeout(noop, FOREVER);
+		} else {
+			waiter.timer = setTimeout(function() {
+				var error = new Error('Timed out waiting for host interrupt ' + self.host);
+				error.code = 'ETIMEDOUT';
+				self.waiters.splice(self.waiters.indexOf(waiter), 1);
+				reject(error);
+			}, timeout);
+		}
+		self.waiters.push(waiter);
+	});
+};
+
+Subscription.prototype.close = function(error) {
+	var waiters = this.waiters;
+
+	if (subscriptions[this.host] === this) {
+		subscriptions[this.host] = undefined;
+	}
+	this.error = error;
+	this.waiters = [];
+	waiters.forEach(function(waiter) {
+		clearTimeout(waiter.timer);
+		waiter.reject(error);
+	});
+};
+
+/* Get the subscription of a host, replacing it if autoClear changed */
+function subscribe(host, options) {
+	var autoClear = options && options.autoClear;
+	var subscription = subscriptions[host];
+
+	if (subscription && subscription.autoClear === autoClear) {
+		return subscription;
+	}
+
+	var replacement = new Subscription(host, autoClear);
+	if (subscription) {
+		// Waits in progress carry over to the new subscription
+		replacement.waiters = subscription.waiters;
+		replacement.queue = subscription.queue;
+		subscription.waiters = [];
+	}
+	subscriptions[host] = replacement;
+	return replacement;
+}
+
+function cancelled() {
+	return new Error('Interrupt subscription cancelled');
+}
+
+/* Subscribe to a host on behalf of a stream or block reader
+ *	Native subscriptions replace each other, so two consumers of one host would silently
+ *	starve the first. A host with any subscriber, callback or promise, is refused instead.
+ *	Returns the owner token to hand to releaseHost()
+ */
+function claimHost(host, options, callback) {
+	if (claims[host] || subscriptions[host]) {
+		throw new Error('Host interrupt ' + host + ' already has a subscriber');
+	}
+
+	var owner = {};
+	pru.onInterrupt(host, options, callback);
+	claims[host] = owner;
+	return owner;
+}
+
+/* Cancel the subscription of owner, unless someone else has replaced it since */
+function releaseHost(host, owner) {
+	if (owner && claims[host] === owner) {
+		pru.offInterrupt(host);
+	}
+}
+
+/* Wait for the next interrupt of a host
+ *	Interrupts that arrived since the previous call are delivered first, in order.
+ *
+ *	@param {number} host interrupt (PRU_EVTOUT_0..7)
+ *	@param {object} [options] { timeout: ms, autoClear: system event }
+ *	@returns {Promise} { host, count, missed }
+ */
+pru.nextInterrupt = function(host, options) {
+	try {
+		return subscribe(host, options).next(options && options.timeout);
+	} catch (e) {
+		return Promise.reject(e);
+	}
+};
+
+/* Async iterator over the interrupts of a host
+ *	for await (const ev of pru.interrupts(0, { autoClear: 19 })) { ... }
+ *	Ending the loop ends the promise subscription of the host, and waits still pending
+ *	on it, from nextInterrupt() too, are rejected.
+ *
+ *	@param {number} host interrupt (PRU_EVTOUT_0..7)
+ *	@param {object} [options] { timeout: ms per interrupt, autoClear: system event }
+ */
+pru.interrupts = function(host, options) {
+	var subscription = subscribe(host, options);
+	var timeout = options && options.timeout;
+	var done = false;
+
+	var iterator = {
+		next: function() {
+			if (done) {
+				return Promise.resolve({ value: undefined, done: true });
+			}
+			return subscription.next(timeout).then(function(event) {
+				return { value: event, done: false };
+			});
+		},
+		return: function() {
+			done = true;
+			// Unless the subscription was replaced since, the native watcher is still ours
+			if (subscriptions[host] === subscription) {
+				subscription.close(cancelled());
+				nativeOffInterrupt(host);
+			}
+			return Promise.resolve({ value: undefined, done: true });
+		}
+	};
+
+	if (typeof Symbol === 'function' && Symbol.asyncIterator) {
+		iterator[Symbol.asyncIterator] = function() {
+			return iterator;
+		};
+	}
+	return iterator;
+};
+
+/* Zero-copy Buffer over a whole memory region */
+function regionView(region) {
+	switch (region) {
+	case pru.DATARAM0:
+		return pru.mapDataRAM(0);
+	case pru.DATARAM1:
+		return pru.mapDataRAM(1);
+	case pru.SHAREDRAM:
+		return pru.mapSharedRAM();
+	default:
+		return pru.mapExtRAM();
+	}
+}
+
+/* Hand JS every block the PRU fills, see firmware/pru_stream.h
+ *	Blocks are zero-copy views of the data region, created once. Each one is handed back
+ *	to the PRU when the callback returns, so it must not be kept past that, copy it if needed.
+ *
+ *	The interrupt host must have no other subscriber, or an Error is thrown.
+ *
+ *	@param {object} options createBlockReader() options plus { interrupt: host, autoClear: system event }
+ *	@param {function} callback(err, block, index)
+ *	@returns {object} { reader, close() }
+ */
+pru.readBlocks = function(options, callback) {
+	var reader = pru.createBlockReader(options);
+	var data = regionView(reader.dataRegion);
+	var host = options.interrupt === undefined ? 0 : options.interrupt;
+	var blocks = [];
+	var closed = false;
+
+	for (var i = 0; i < reader.blocks; i++) {
+		var start = reader.dataOffset + i * reader.blockSize;
+		blocks.push(data.slice(start, start + reader.blockSize));
+	}
+
+	var owner = claimHost(host, { autoClear: options.autoClear }, function(err) {
+		if (err) {
+			closed = true;
+			releaseHost(host, owner);
+			return callback(err);
+		}
+
+		var index;
+		while (!closed && (index = reader.next()) >= 0) {
+			try {
+				callback(null, blocks[index], index);
+			} finally {
+				if (!closed) {
+					reader.release();
+				}
+			}
+		}
+	});
+
+	return {
+		reader: reader,
+		close: function() {
+			if (!closed) {
+				closed = true;
+				releaseHost(host, owner);
+			}
+		}
+	};
+};
+
+/* Fixed-size chunk allocator, a slab is split into chunks instead of allocating each one */
+function ChunkPool(chunkSize) {
+	this.chunkSize = chunkSize;
+	this.slabSize = Math.max(1, Math.floor(POOL_SIZE / chunkSize)) * chunkSize;
+	this.slab = null;
+	this.used = 0;
+}
+
+ChunkPool.prototype.alloc = function() {
+	if (this.slab === null || this.used === this.slabSize) {
+		this.slab = Buffer.allocUnsafe(this.slabSize);
+		this.used = 0;
+	}
+	var chunk = this.slab.slice(this.used, this.used + this.chunkSize);
+	this.used += this.chunkSize;
+	return chunk;
+};
+
+/* Chunk source over a block stream, see firmware/pru_stream.h */
+function BlockSource(options) {
+	var reader = pru.createBlockReader(options);
+	var data = regionView(reader.dataRegion);
+
+	this.reader = reader;
+	this.data = data;
+	this.pool = new ChunkPool(reader.blockSize);
+	this.flag = { region: reader.region, offset: reader.offset + STREAM_FLAGS };
+}
+
+// The block goes back to the PRU right away, so it is copied out once, into the pool
+BlockSource.prototype.take = function() {
+	var index = this.reader.next();
+	if (index < 0) {
+		return null;
+	}
+
+	var start = this.reader.dataOffset + index * this.reader.blockSize;
+	var chunk = this.pool.alloc();
+	this.data.copy(chunk, 0, start, start + this.reader.blockSize);
+	this.reader.release();
+	return chunk;
+};
+
+BlockSource.prototype.full = function() {
+	return this.reader.available() >= this.reader.blocks;
+};
+
+/* Chunk source over a ring buffer, see firmware/pru_ring.h
+ *	Each chunk holds blockSize / elementSize elements, the ring read allocates it already
+ */
+function RingSource(options) {
+	var ring = pru.createRing(options);
+
+	this.ring = ring;
+	this.count = Math.max(1, Math.floor((options.blockSize || ring.elementSize) / ring.elementSize));
+	if (this.count > ring.capacity) {
+		throw new RangeError('blockSize is larger than the ring');
+	}
+	this.flag = options.overflowFlag;
+}
+
+RingSource.prototype.take = function() {
+	if (this.ring.available() < this.count) {
+		return null;
+	}
+	return this.ring.read(this.count);
+};
+
+RingSource.prototype.full = function() {
+	return this.ring.available() >= this.ring.capacity;
+};
+
+/* Readable stream of the data the PRU produces
+ *	Every interrupt drains the source into fixed-size chunks for as long as the consumer
+ *	wants more. When it falls behind and the PRU has filled everything, the overflow flag
+ *	word is set so the firmware knows data is being lost, and cleared once it catches up.
+ */
+function PruReadStream(options) {
+	var self = this;
+
+	Readable.call(this, { highWaterMark: options.highWaterMark });
+
+	this.source = options.layout === 'ring' ? new RingSource(options) : new BlockSource(options);
+	this.host = options.interrupt === undefined ? 0 : options.interrupt;
+	this.wanted = false;
+	this.overflow = false;
+
+	this.owner = claimHost(this.host, { autoClear: options.autoClear }, function(err) {
+		if (err) {
+			self.destroy(err);
+		} else {
+			self.drain();
+		}
+	});
+}
+util.inherits(PruReadStream, Readable);
+
+PruReadStream.prototype.setOverflow = function(overflow) {
+	var flag = this.source.flag;
+	if (overflow !== this.overflow && flag) {
+		pru.writeUInt32(flag.region, flag.offset, overflow ? STREAM_FLAG_OVERFLOW : 0);
+	}
+	this.overflow = overflow;
+};
+
+PruReadStream.prototype.drain = function() {
+	var chunk;
+	while (this.wanted && (chunk = this.source.take()) !== null) {
+		this.wanted = this.push(chunk);
+	}
+	this.setOverflow(!this.wanted && this.source.full());
+};
+
+PruReadStream.prototype._read = function() {
+	this.wanted = true;
+	this.drain();
+};
+
+PruReadStream.prototype._destroy = function(err, callback) {
+	releaseHost(this.host, this.owner);
+	callback(err);
+};
+
+/* Readable stream of PRU data, for piping captures into files and sockets
+ *	layout "blocks" (default) reads a block stream, region and offset locate its header and
+ *	the other options are those of createBlockReader(). layout "ring" reads a ring buffer,
+ *	with the options of createRing() and chunks of blockSize bytes worth of elements.
+ *	The interrupt host must have no other subscriber, or an Error is thrown.
+ *
+ *	@param {object} options { layout, region, offset, blockSize, interrupt, autoClear, overflowFlag, highWaterMark }
+ *	@returns {stream.Readable}
+ */
+pru.createReadStream = function(options) {
+	return new PruReadStream(options || {});
+};
+
+/* Compile a command layout into a packer
+ *	A layout lists the fields of a command in order, as type names or [name, type] pairs.
+ *	Fields are naturally aligned and the size rounded up to 4 bytes, as a C compiler
+ *	lays out the matching struct for the firmware.
+ */
+function Layout(fields) {
+	var offset = 0;
+
+	this.fields = fields.map(function(field, index) {
+		var name = Array.isArray(field) ? field[0] : index;
+		var type = FIELD_TYPES[Array.isArray(field) ? field[1] : field];
+		if (!type) {
+			throw new TypeError('Unknown field type ' + field);
+		}
+
+		offset = Math.ceil(offset / type[0]) * type[0];
+		var packed = { name: name, offset: offset, write: type[1] };
+		offset += type[0];
+		return packed;
+	});
+	this.size = Math.ceil(offset / 4) * 4;
+}
+
+// A command is an array of values in field order, an object keyed by field name, or a packed Buffer
+Layout.prototype.pack = function(command, buffer, offset) {
+	if (Buffer.isBuffer(command)) {
+		if (command.length !== this.size) {
+			throw new RangeError('Packed commands must be ' + this.size + ' bytes');
+		}
+		command.copy(buffer, offset);
+		return;
+	}
+
+	var byIndex = Array.isArray(command);
+	for (var i = 0; i < this.fields.length; i++) {
+		var field = this.fields[i];
+		buffer[field.write](command[byIndex ? i : field.name], offset + field.offset);
+	}
+};
+
+/* Writable stream of commands for a ring buffer the PRU drains, see firmware/pru_ring.h
+ *	Commands buffered by the stream are packed together and written to the ring in one
+ *	native call. When the ring is full the write only completes once the firmware has
+ *	freed slots, which is what applies backpressure.
+ */
+function PruWriteStream(options) {
+	var self = this;
+
+	Writable.call(this, { objectMode: true, highWaterMark: options.highWaterMark });
+
+	this.layout = new Layout(options.layout || ['uint32']);
+	this.ring = pru.createRing({
+		region: options.region,
+		offset: options.offset,
+		capacity: options.capacity,
+		elementSize: options.capacity === undefined ? undefined : this.layout.size
+	});
+	if (this.ring.elementSize !== this.layout.size) {
+		throw new RangeError('The ring holds ' + this.ring.elementSize + ' byte elements, the layout packs ' + this.layout.size);
+	}
+
+	this.event = options.event;
+	this.host = options.interrupt;
+	this.data = null;
+	this.callback = null;
+	this.timer = null;
+	this.owner = null;
+
+	// The firmware may raise a host interrupt when it frees slots, instead of being polled
+	if (this.host !== undefined) {
+		this.owner = claimHost(this.host, { ref: false, autoClear: options.autoClear }, function(err) {
+			if (err) {
+				self.destroy(err);
+			} else {
+				self.flush();
+			}
+		});
+	}
+}
+util.inherits(PruWriteStream, Writable);
+
+PruWriteStream.prototype.flush = function() {
+	var self = this;
+
+	if (this.data === null) {
+		return;
+	}
+
+	var written = this.event === undefined ? this.ring.write(this.data) : this.ring.write(this.data, this.event);
+	this.data = this.data.slice(written * this.layout.size);
+	if (this.data.length === 0) {
+		var callback = this.callback;
+		clearTimeout(this.timer);
+		this.data = null;
+		this.callback = null;
+		return callback();
+	}
+
+	// Ring full: keep the process alive, and poll unless an interrupt will tell us
+	clearTimeout(this.timer);
+	this.timer = setTimeout(function() {
+		self.flush();
+	}, this.host === undefined ? RETRY_INTERVAL : FOREVER);
+};
+
+PruWriteStream.prototype._writev = function(chunks, callback) {
+	var size = this.layout.size;
+	var data = Buffer.alloc(chunks.length * size);
+
+	try {
+		for (var i = 0; i < chunks.length; i++) {
+			this.layout.pack(chunks[i].chunk, data, i * size);
+		}
+	} catch (e) {
+		return callback(e);
+	}
+
+	this.data = data;
+	this.callback = callback;
+	this.flush();
+};
+
+PruWriteStream.prototype._write = function(chunk, encoding, callback) {
+	this._writev([{ chunk: chunk }], callback);
+};
+
+PruWriteStream.prototype._destroy = function(err, callback) {
+	clearTimeout(this.timer);
+	this.data = null;
+	releaseHost(this.host, this.owner);
+	callback(err);
+};
+
+PruWriteStream.prototype._final = function(callback) {
+	releaseHost(this.host, this.owner);
+	callback();
+};
+
+/* Writable stream feeding commands to the PRU through a ring buffer
+ *	region, offset and capacity place a new ring as for createRing(), without capacity the
+ *	ring the firmware set up is used. With an event, the PRU is interrupted only when it had
+ *	emptied the ring, e.g. pru.ARM_PRU0_INTERRUPT. An interrupt host must have no other
+ *	subscriber, or an Error is thrown.
+ *
+ *	@param {object} options { region, offset, capacity, layout, event, interrupt, autoClear, highWaterMark }
+ *	@returns {stream.Writable} taking commands packed by layout, e.g. [['steps', 'int32'], ['period', 'uint32']]
+ */
+pru.createWriteStream = function(options) {
+	return new PruWriteStream(options || {});
+};
+
+// A callback subscription or an explicit cancel replaces the promise one, and the
+// subscription of a stream, which then no longer cancels the new one when it ends
+pru.onInterrupt = function(host) {
+	var subscription = subscriptions[host];
+	if (subscription) {
+		subscription.close(cancelled());
+	}
+	var result = nativeOnInterrupt.apply(pru, arguments);
+	claims[host] = {};
+	return result;
+};
+
+pru.offInterrupt = function(host) {
+	var subscription = subscriptions[host];
+	if (subscription) {
+		subscription.close(cancelled());
+	}
+	claims[host] = undefined;
+	return nativeOffInterrupt.apply(pru, arguments);
+};
+
+// Closing the driver ends every promise subscription, pending waits are rejected
+pru.exit = function() {
+	subscriptions.forEach(function(subscription) {
+		if (subscription) {
+			subscription.close(cancelled());
+		}
+	});
+	claims = [];
+	return nativeExit.apply(pru, arguments);
+};
+
+module.exports = pru;
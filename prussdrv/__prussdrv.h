@@ -190,6 +190,19 @@
 #endif
 
 
+// Longest wait for a PRU to finish its current instruction when halting or stepping
+#define PRU_CONTROL_TIMEOUT_US        10000
+// Polled without sleeping for this long, an instruction normally completes within it
+#define PRU_CONTROL_SPIN_US           20
+#define PRU_CONTROL_POLL_NS           50000
+
+//Simulated PRUSS, see prussdrv_simulate()
+#define PRUSS_SIM_ENV                 "PRUSS_SIMULATOR"
+#define PRUSS_SIM_MMAP_SIZE           AM33XX_PRUSS_MMAP_SIZE
+#define PRUSS_SIM_EXTRAM_SIZE         0x40000
+#define PRUSS_SIM_EXTRAM_PHYS_BASE    0x9e000000
+#define PRUSS_SIM_MFD_CLOEXEC         0x0001U
+
 typedef struct __prussdrv {
     int version;
     int fd[NUM_PRU_HOSTIRQS];
@@ -237,6 +250,18 @@ typedef struct __prussdrv {
     unsigned int extram_phys_base;
     unsigned int extram_map_size;
     tpruss_intc_initdata intc_data;
+    // Lookup tables derived from intc_data, -1 where unmapped
+    short sysevt_to_channel[NUM_PRU_SYS_EVTS];
+    short sysevt_to_host[NUM_PRU_SYS_EVTS];
+    short channel_to_host[NUM_PRU_CHANNELS];
+    // Simulated PRUSS state
+    int simulated;
+    int sim_memfd;
+    unsigned int sim_count[NUM_PRU_HOSTIRQS];
+    unsigned char sim_masked[NUM_PRU_HOSTIRQS];
+    unsigned char sim_pending[NUM_PRU_HOSTIRQS];
+    // Hosts fed by prussdrv_pru_attach_event_fd(), read as UIO even when simulated
+    unsigned char fd_attached[NUM_PRU_HOSTIRQS];
 } tprussdrv;
 
 
@@ -0,0 +1,91 @@
+/*
+ * pruss_copy.c
+ *
+ * Bulk copies between host memory and PRU memory, see pruss_copy.h
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define PRUSS_COPY_NEON
+#endif
+
+#include "pruss_copy.h"
+
+void pruss_copy_to_device(volatile void *dst, const void *src, size_t len)
+{
+    volatile uint8_t *d = (volatile uint8_t *) dst;
+    const uint8_t *s = (const uint8_t *) src;
+    uint32_t word;
+    size_t i, words;
+
+    // Bytes up to the first aligned word of PRU memory
+    while (len > 0 && ((uintptr_t) d & 3)) {
+        *d++ = *s++;
+        len--;
+    }
+
+#ifdef PRUSS_COPY_NEON
+    // 16 byte bursts, PRU memory is at least word aligned here
+    while (len >= 16) {
+        vst1q_u32((uint32_t *) d, vreinterpretq_u32_u8(vld1q_u8(s)));
+        d += 16;
+        s += 16;
+        len -= 16;
+    }
+#endif
+
+    words = len >> 2;
+    for (i = 0; i < words; i++) {
+        memcpy(&word, s + 4 * i, 4);
+        ((volatile uint32_t *) d)[i] = word;
+    }
+    d += 4 * words;
+    s += 4 * words;
+    len &= 3;
+
+    while (len > 0) {
+        *d++ = *s++;
+        len--;
+    }
+}
+
+void pruss_copy_from_device(void *dst, const volatile void *src, size_t len)
+{
+    uint8_t *d = (uint8_t *) dst;
+    const volatile uint8_t *s = (const volatile uint8_t *) src;
+    uint32_t word;
+    size_t i, words;
+
+    // Bytes up to the first aligned word of PRU memory
+    while (len > 0 && ((uintptr_t) s & 3)) {
+        *d++ = *s++;
+        len--;
+    }
+
+#ifdef PRUSS_COPY_NEON
+    // 16 byte bursts, PRU memory is at least word aligned here
+    while (len >= 16) {
+        vst1q_u8(d, vreinterpretq_u8_u32(vld1q_u32((const uint32_t *) s)));
+        d += 16;
+        s += 16;
+        len -= 16;
+    }
+#endif
+
+    words = len >> 2;
+    for (i = 0; i < words; i++) {
+        word = ((const volatile uint32_t *) s)[i];
+        memcpy(d + 4 * i, &word, 4);
+    }
+    d += 4 * words;
+    s += 4 * words;
+    len &= 3;
+
+    while (len > 0) {
+        *d++ = *s++;
+        len--;
+    }
+}
@@ -0,0 +1,30 @@
+/*
+ * pruss_copy.h
+ *
+ * Bulk copies between host memory and PRU memory
+ *
+ * PRU memory is mapped uncached through the OCP interconnect, so every access
+ * is a bus transaction. These copies only touch PRU memory with aligned 32 bit
+ * (or, with NEON, aligned 128 bit) accesses, using byte accesses for an unaligned
+ * head and tail only. Host memory may have any alignment.
+ */
+
+#ifndef _PRUSS_COPY_H
+#define _PRUSS_COPY_H
+
+#include <stddef.h>
+
+#if defined (__cplusplus)
+extern "C" {
+#endif
+
+    /** Copy len bytes from host memory to PRU memory. */
+    void pruss_copy_to_device(volatile void *dst, const void *src, size_t len);
+
+    /** Copy len bytes from PRU memory to host memory. */
+    void pruss_copy_from_device(void *dst, const volatile void *src, size_t len);
+
+#if defined (__cplusplus)
+}
+#endif
+#endif
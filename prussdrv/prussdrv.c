@@ -49,7 +49,12 @@
 
 #include <prussdrv.h>
 #include "__prussdrv.h"
+#include "pruss_copy.h"
 #include <stdio.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <poll.h>
+#include <pthread.h>
 
 #ifdef __DEBUG
 #define DEBUG_PRINTF(FORMAT, ...) fprintf(stderr, FORMAT, ## __VA_ARGS__)
@@ -63,41 +68,19 @@
 
 static tprussdrv prussdrv;
 
-int __prussdrv_memmap_init(void)
-{
-    int i, fd;
-    char hexstring[PRUSS_UIO_PARAM_VAL_LEN];
+static int __prussdrv_sim_memmap_init(void);
 
-    if (prussdrv.mmap_fd == 0) {
-        for (i = 0; i < NUM_PRU_HOSTIRQS; i++) {
-            if (prussdrv.fd[i])
-                break;
-        }
-        if (i == NUM_PRU_HOSTIRQS)
-            return -1;
-        else
-            prussdrv.mmap_fd = prussdrv.fd[i];
-    }
-    fd = open(PRUSS_UIO_DRV_PRUSS_BASE, O_RDONLY);
-    if (fd >= 0) {
-        read(fd, hexstring, PRUSS_UIO_PARAM_VAL_LEN);
-        prussdrv.pruss_phys_base =
-            strtoul(hexstring, NULL, HEXA_DECIMAL_BASE);
-        close(fd);
-    } else
-        return -1;
-    fd = open(PRUSS_UIO_DRV_PRUSS_SIZE, O_RDONLY);
-    if (fd >= 0) {
-        read(fd, hexstring, PRUSS_UIO_PARAM_VAL_LEN);
-        prussdrv.pruss_map_size =
-            strtoul(hexstring, NULL, HEXA_DECIMAL_BASE);
-        close(fd);
-    } else
-        return -1;
+// Serializes read-modify-writes of the PRU control registers
+static pthread_mutex_t control_lock = PTHREAD_MUTEX_INITIALIZER;
 
-    prussdrv.pru0_dataram_base =
-        mmap(0, prussdrv.pruss_map_size, PROT_READ | PROT_WRITE,
-             MAP_SHARED, prussdrv.mmap_fd, PRUSS_UIO_MAP_OFFSET_PRUSS);
+// Guards sim_count, sim_masked and sim_pending, which the loop threads and the
+// interrupt threads update as they send, read and clear events
+static pthread_mutex_t sim_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Derive the address of every PRUSS block from the base of the mapping,
+ * once it is mapped at pru0_dataram_base */
+static void __prussdrv_layout_init(void)
+{
     prussdrv.version =
         __pruss_detect_hw_version(prussdrv.pru0_dataram_base);
 
@@ -190,6 +173,48 @@ int __prussdrv_memmap_init(void)
             prussdrv.pru0_dataram_base + prussdrv.pruss_mdio_phy_base -
             prussdrv.pru0_dataram_phy_base;
     }
+}
+
+int __prussdrv_memmap_init(void)
+{
+    int i, fd;
+    char hexstring[PRUSS_UIO_PARAM_VAL_LEN];
+
+    if (prussdrv.simulated)
+        return __prussdrv_sim_memmap_init();
+
+    if (prussdrv.mmap_fd == 0) {
+        for (i = 0; i < NUM_PRU_HOSTIRQS; i++) {
+            if (prussdrv.fd[i])
+                break;
+        }
+        if (i == NUM_PRU_HOSTIRQS)
+            return -1;
+        else
+            prussdrv.mmap_fd = prussdrv.fd[i];
+    }
+    fd = open(PRUSS_UIO_DRV_PRUSS_BASE, O_RDONLY);
+    if (fd >= 0) {
+        read(fd, hexstring, PRUSS_UIO_PARAM_VAL_LEN);
+        prussdrv.pruss_phys_base =
+            strtoul(hexstring, NULL, HEXA_DECIMAL_BASE);
+        close(fd);
+    } else
+        return -1;
+    fd = open(PRUSS_UIO_DRV_PRUSS_SIZE, O_RDONLY);
+    if (fd >= 0) {
+        read(fd, hexstring, PRUSS_UIO_PARAM_VAL_LEN);
+        prussdrv.pruss_map_size =
+            strtoul(hexstring, NULL, HEXA_DECIMAL_BASE);
+        close(fd);
+    } else
+        return -1;
+
+    prussdrv.pru0_dataram_base =
+        mmap(0, prussdrv.pruss_map_size, PROT_READ | PROT_WRITE,
+             MAP_SHARED, prussdrv.mmap_fd, PRUSS_UIO_MAP_OFFSET_PRUSS);
+    __prussdrv_layout_init();
+
 #ifndef DISABLE_L3RAM_SUPPORT
     fd = open(PRUSS_UIO_DRV_L3RAM_BASE, O_RDONLY);
     if (fd >= 0) {
@@ -242,9 +267,108 @@ int __prussdrv_memmap_init(void)
 
 }
 
+/*
+ * Simulated PRUSS
+ *
+ * Stands in for /dev/uioN and its sysfs maps so the driver runs on any Linux box.
+ * The PRUSS address space, with the AM33XX layout, and the external RAM live in
+ * one memfd, so another process can map the same memory through /proc/<pid>/fd
+ * and play the PRU side. Host interrupts are eventfds: an event sent with
+ * prussdrv_pru_send_event() is routed through the INTC mapping set up by
+ * prussdrv_pruintc_init() and signals the eventfd of its host interrupt, which
+ * then stays masked until prussdrv_pru_clear_event(), as with UIO.
+ * Nothing executes PRU code, enabling a PRU only writes its control register.
+ */
+
+static int __prussdrv_sim_memmap_init(void)
+{
+    char *base;
+    size_t total = PRUSS_SIM_MMAP_SIZE + PRUSS_SIM_EXTRAM_SIZE;
+
+    prussdrv.sim_memfd = syscall(SYS_memfd_create, "pruss-sim", PRUSS_SIM_MFD_CLOEXEC);
+    if (prussdrv.sim_memfd < 0 || ftruncate(prussdrv.sim_memfd, total) != 0) {
+        DEBUG_PRINTF("Simulated PRUSS memory could not be created\n");
+        return -1;
+    }
+
+    base = mmap(0, total, PROT_READ | PROT_WRITE, MAP_SHARED, prussdrv.sim_memfd, 0);
+    if (base == MAP_FAILED)
+        return -1;
+
+    prussdrv.pruss_phys_base = AM33XX_DATARAM0_PHYS_BASE;
+    prussdrv.pruss_map_size = PRUSS_SIM_MMAP_SIZE;
+    prussdrv.pru0_dataram_base = base;
+    prussdrv.extram_phys_base = PRUSS_SIM_EXTRAM_PHYS_BASE;
+    prussdrv.extram_map_size = PRUSS_SIM_EXTRAM_SIZE;
+    prussdrv.extram_base = base + PRUSS_SIM_MMAP_SIZE;
+
+    // What __pruss_detect_hw_version() looks for in a real INTC
+    *(volatile unsigned int *) (base + AM33XX_INTC_PHYS_BASE -
+                                AM33XX_DATARAM0_PHYS_BASE +
+                                PRU_INTC_REVID_REG) = AM33XX_PRUSS_INTC_REV;
+
+    __prussdrv_layout_init();
+    return 0;
+}
+
+static int __prussdrv_sim_open(unsigned int host_interrupt)
+{
+    int fd = eventfd(0, EFD_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    pthread_mutex_lock(&sim_lock);
+    prussdrv.fd[host_interrupt] = fd;
+    prussdrv.sim_count[host_interrupt] = 0;
+    prussdrv.sim_masked[host_interrupt] = 0;
+    prussdrv.sim_pending[host_interrupt] = 0;
+    pthread_mutex_unlock(&sim_lock);
+    if (prussdrv.pru0_dataram_base)
+        return 0;
+    return __prussdrv_memmap_init();
+}
+
+/* Called with sim_lock held. */
+static void __prussdrv_sim_signal(unsigned int host_interrupt)
+{
+    uint64_t one = 1;
+
+    if (prussdrv.fd[host_interrupt] <= 0 || prussdrv.fd_attached[host_interrupt])
+        return;
+    if (prussdrv.sim_masked[host_interrupt]) {
+        prussdrv.sim_pending[host_interrupt] = 1;
+        return;
+    }
+    prussdrv.sim_masked[host_interrupt] = 1;
+    write(prussdrv.fd[host_interrupt], &one, sizeof(one));
+}
+
+int prussdrv_simulate(int enable)
+{
+    if (prussdrv.pru0_dataram_base)
+        return -1;
+    prussdrv.simulated = enable ? 1 : 0;
+    return 0;
+}
+
+int prussdrv_is_simulated(void)
+{
+    return prussdrv.simulated;
+}
+
+static void __prussintc_reset_maps(void)
+{
+    memset(prussdrv.sysevt_to_channel, -1, sizeof(prussdrv.sysevt_to_channel));
+    memset(prussdrv.sysevt_to_host, -1, sizeof(prussdrv.sysevt_to_host));
+    memset(prussdrv.channel_to_host, -1, sizeof(prussdrv.channel_to_host));
+}
+
 int prussdrv_init(void)
 {
+    const char *simulate = getenv(PRUSS_SIM_ENV);
+
     memset(&prussdrv, 0, sizeof(prussdrv));
+    __prussintc_reset_maps();
+    prussdrv.simulated = simulate && *simulate && strcmp(simulate, "0") != 0;
     return 0;
 
 }
@@ -252,9 +376,20 @@ int prussdrv_init(void)
 int prussdrv_open(unsigned int host_interrupt)
 {
     char name[PRUSS_UIO_PRAM_PATH_LEN];
+    if (host_interrupt >= NUM_PRU_HOSTIRQS)
+        return -1;
     if (!prussdrv.fd[host_interrupt]) {
+        if (prussdrv.simulated)
+            return __prussdrv_sim_open(host_interrupt);
         sprintf(name, "/dev/uio%d", host_interrupt);
         prussdrv.fd[host_interrupt] = open(name, O_RDWR | O_SYNC);
+        if (prussdrv.fd[host_interrupt] < 0) {
+            prussdrv.fd[host_interrupt] = 0;
+            return -1;
+        }
+        // The PRUSS is mapped once, by whichever host interrupt is opened first
+        if (prussdrv.pru0_dataram_base)
+            return 0;
         return __prussdrv_memmap_init();
     } else {
         return -1;
@@ -277,19 +412,86 @@ const char * prussdrv_strversion(int version) {
     }
 }
 
-int prussdrv_pru_reset(unsigned int prunum)
+static volatile uint32_t *__prussdrv_control_regs(unsigned int prunum)
 {
-    unsigned int *prucontrolregs;
+    if (prussdrv.pru0_dataram_base == NULL)
+        return NULL;
     if (prunum == 0)
-        prucontrolregs = (unsigned int *) prussdrv.pru0_control_base;
+        return (volatile uint32_t *) prussdrv.pru0_control_base;
     else if (prunum == 1)
-        prucontrolregs = (unsigned int *) prussdrv.pru1_control_base;
+        return (volatile uint32_t *) prussdrv.pru1_control_base;
+    return NULL;
+}
+
+/* Nothing executes code in the simulator, so the effect of a control register write
+ * on the run state and program counter is emulated: a reset loads the start address,
+ * RUNSTATE follows ENABLE and a single step advances the program counter and halts.
+ * Called with control_lock held.
+ */
+static void __prussdrv_sim_control(volatile uint32_t *prucontrolregs)
+{
+    uint32_t value = *prucontrolregs;
+
+    if (!(value & PRU_CONTROL_SOFT_RST_N)) {
+        prucontrolregs[PRU_STATUS_REG / 4] = value >> 16;
+        value |= PRU_CONTROL_SOFT_RST_N;
+    }
+    if ((value & PRU_CONTROL_ENABLE) && (value & PRU_CONTROL_SINGLE_STEP)) {
+        prucontrolregs[PRU_STATUS_REG / 4] =
+            (prucontrolregs[PRU_STATUS_REG / 4] + 1) & PRU_STATUS_PCOUNTER_MASK;
+        value &= ~PRU_CONTROL_ENABLE;
+    }
+    if (value & PRU_CONTROL_ENABLE)
+        value |= PRU_CONTROL_RUNSTATE;
     else
+        value &= ~PRU_CONTROL_RUNSTATE;
+    *prucontrolregs = value & ~PRU_CONTROL_SLEEPING;
+}
+
+static int __prussdrv_write_control(unsigned int prunum, uint32_t value)
+{
+    volatile uint32_t *prucontrolregs = __prussdrv_control_regs(prunum);
+    if (prucontrolregs == NULL)
         return -1;
-    *prucontrolregs = 0;
+    pthread_mutex_lock(&control_lock);
+    *prucontrolregs = value;
+    if (prussdrv.simulated)
+        __prussdrv_sim_control(prucontrolregs);
+    pthread_mutex_unlock(&control_lock);
     return 0;
 }
 
+/* Wait for bits of the control register to clear, for at most timeout_us
+ * A stalled PRU, e.g. on a slow OCP access, can take much longer than the
+ * spin, so past it the caller sleeps between polls instead of burning a CPU.
+ */
+static int __prussdrv_wait_control(volatile uint32_t *prucontrolregs,
+                                   uint32_t bits, unsigned int timeout_us)
+{
+    struct timespec start, now;
+    struct timespec poll_interval = { 0, PRU_CONTROL_POLL_NS };
+    long elapsed_us;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while (*prucontrolregs & bits) {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        elapsed_us = (now.tv_sec - start.tv_sec) * 1000000 +
+            (now.tv_nsec - start.tv_nsec) / 1000;
+        if (elapsed_us > timeout_us) {
+            errno = ETIMEDOUT;
+            return -1;
+        }
+        if (elapsed_us > PRU_CONTROL_SPIN_US)
+            nanosleep(&poll_interval, NULL);
+    }
+    return 0;
+}
+
+int prussdrv_pru_reset(unsigned int prunum)
+{
+    return __prussdrv_write_control(prunum, 0);
+}
+
 int prussdrv_pru_enable(unsigned int prunum)
 {
   return prussdrv_pru_enable_at(prunum, 0);
@@ -297,33 +499,109 @@ int prussdrv_pru_enable(unsigned int prunum)
 
 int prussdrv_pru_enable_at(unsigned int prunum, size_t addr)
 {
-    volatile uint32_t* prucontrolregs;
-    if (prunum == 0)
-        prucontrolregs = (volatile uint32_t *) prussdrv.pru0_control_base;
-    else if (prunum == 1)
-        prucontrolregs = (volatile uint32_t *) prussdrv.pru1_control_base;
-    else
+    /* address is in bytes and must be converted in 32 bits words */
+    return __prussdrv_write_control(prunum,
+                                    ((uint32_t)(addr / sizeof(uint32_t)) << 16) | 2);
+}
+
+int prussdrv_pru_disable(unsigned int prunum)
+{
+    return __prussdrv_write_control(prunum, 1);
+}
+
+int prussdrv_pru_update_control(unsigned int prunum, unsigned int clear,
+                                unsigned int set)
+{
+    volatile uint32_t *prucontrolregs = __prussdrv_control_regs(prunum);
+    uint32_t value;
+    if (prucontrolregs == NULL)
         return -1;
+    pthread_mutex_lock(&control_lock);
+    value = (*prucontrolregs & ~clear) | set;
+    // Writing SLEEPING as 0 wakes the PRU up, keep it at 1 unless asked to
+    *prucontrolregs = value | (~clear & PRU_CONTROL_SLEEPING);
+    if (prussdrv.simulated)
+        __prussdrv_sim_control(prucontrolregs);
+    pthread_mutex_unlock(&control_lock);
+    return (int) (value & 0x7FFFFFFF);
+}
 
-    /* address is in bytes and must be converted in 32 bits words */
-    *prucontrolregs = ((uint32_t)(addr / sizeof(uint32_t)) << 16) | 2;
+int prussdrv_pru_reset_counters(unsigned int prunum)
+{
+    volatile uint32_t *prucontrolregs = __prussdrv_control_regs(prunum);
+    uint32_t value;
+    if (prucontrolregs == NULL)
+        return -1;
+    pthread_mutex_lock(&control_lock);
+    // The counters can only be written while they are disabled
+    value = *prucontrolregs | PRU_CONTROL_SLEEPING;
+    *prucontrolregs = value & ~PRU_CONTROL_COUNTER_ENABLE;
+    prucontrolregs[PRU_CYCLE_REG / 4] = 0;
+    prucontrolregs[PRU_STALL_REG / 4] = 0;
+    *prucontrolregs = value | PRU_CONTROL_COUNTER_ENABLE;
+    if (prussdrv.simulated)
+        __prussdrv_sim_control(prucontrolregs);
+    pthread_mutex_unlock(&control_lock);
+    return 0;
+}
 
+int prussdrv_pru_halt(unsigned int prunum)
+{
+    volatile uint32_t *prucontrolregs = __prussdrv_control_regs(prunum);
+    if (prussdrv_pru_update_control(prunum, PRU_CONTROL_ENABLE, 0) < 0)
+        return -1;
+    return __prussdrv_wait_control(prucontrolregs, PRU_CONTROL_RUNSTATE,
+                                   PRU_CONTROL_TIMEOUT_US);
+}
+
+int prussdrv_pru_resume(unsigned int prunum)
+{
+    if (prussdrv_pru_update_control(prunum, PRU_CONTROL_SINGLE_STEP,
+                                    PRU_CONTROL_ENABLE | PRU_CONTROL_SOFT_RST_N) < 0)
+        return -1;
     return 0;
+}
+
+int prussdrv_pru_step(unsigned int prunum, unsigned int count)
+{
+    volatile uint32_t *prucontrolregs = __prussdrv_control_regs(prunum);
+    unsigned int i;
+    int rc = 0;
+
+    if (prucontrolregs == NULL)
+        return -1;
+    if (*prucontrolregs & (PRU_CONTROL_ENABLE | PRU_CONTROL_RUNSTATE)) {
+        errno = EBUSY;
+        return -1;
+    }
+
+    // Each write of ENABLE executes one instruction, then the PRU clears ENABLE again
+    for (i = 0; i < count && rc == 0; i++) {
+        prussdrv_pru_update_control(prunum, 0,
+                                    PRU_CONTROL_SINGLE_STEP | PRU_CONTROL_ENABLE);
+        rc = __prussdrv_wait_control(prucontrolregs,
+                                     PRU_CONTROL_ENABLE | PRU_CONTROL_RUNSTATE,
+                                     PRU_CONTROL_TIMEOUT_US);
+    }
+    prussdrv_pru_update_control(prunum, PRU_CONTROL_SINGLE_STEP, 0);
+    return rc;
+}
 
+int prussdrv_map_pru_control(unsigned int prunum, void **address)
+{
+    *address = (void *) __prussdrv_control_regs(prunum);
+    return *address ? 0 : -1;
 }
 
-int prussdrv_pru_disable(unsigned int prunum)
+int prussdrv_map_pru_debug(unsigned int prunum, void **address)
 {
-    unsigned int *prucontrolregs;
     if (prunum == 0)
-        prucontrolregs = (unsigned int *) prussdrv.pru0_control_base;
+        *address = prussdrv.pru0_debug_base;
     else if (prunum == 1)
-        prucontrolregs = (unsigned int *) prussdrv.pru1_control_base;
+        *address = prussdrv.pru1_debug_base;
     else
-        return -1;
-    *prucontrolregs = 1;
-    return 0;
-
+        *address = NULL;
+    return *address ? 0 : -1;
 }
 
 int prussdrv_pru_write_memory(unsigned int pru_ram_id,
@@ -331,7 +609,7 @@ int prussdrv_pru_write_memory(unsigned int pru_ram_id,
                               const unsigned int *memarea,
                               unsigned int bytelength)
 {
-    unsigned int *pruramarea, i, wordlength;
+    unsigned int *pruramarea, wordlength;
     switch (pru_ram_id) {
     case PRUSS0_PRU0_IRAM:
         pruramarea = (unsigned int *) prussdrv.pru0_iram_base;
@@ -356,8 +634,15 @@ int prussdrv_pru_write_memory(unsigned int pru_ram_id,
 
 
     wordlength = (bytelength + 3) >> 2; //Adjust length as multiple of 4 bytes
-    for (i = 0; i < wordlength; i++) {
-        *(pruramarea + i + wordoffset) = *(memarea + i);
+    pruss_copy_to_device(pruramarea + wordoffset, memarea, bytelength & ~3);
+    if (bytelength & 3) {
+        // Pad the last word with zeros instead of reading past memarea,
+        // IRAM only takes whole word writes
+        unsigned int lastword = 0;
+        memcpy(&lastword, (const char *) memarea + (bytelength & ~3),
+               bytelength & 3);
+        *(volatile unsigned int *) (pruramarea + wordoffset + wordlength - 1) =
+            lastword;
     }
     return wordlength;
 
@@ -374,7 +659,7 @@ int prussdrv_pruintc_init(const tpruss_intc_initdata *prussintc_init_data)
 
     for (i = 0; i < (NUM_PRU_SYS_EVTS + 3) >> 2; i++)
         pruintc_io[(PRU_INTC_CMR1_REG >> 2) + i] = 0;
-    for (i = 0;
+    for (i = 0; i < NUM_PRU_SYS_EVTS &&
          ((prussintc_init_data->sysevt_to_channel_map[i].sysevt != -1)
           && (prussintc_init_data->sysevt_to_channel_map[i].channel !=
               -1)); i++) {
@@ -386,7 +671,7 @@ int prussdrv_pruintc_init(const tpruss_intc_initdata *prussintc_init_data)
     }
     for (i = 0; i < (NUM_PRU_HOSTS + 3) >> 2; i++)
         pruintc_io[(PRU_INTC_HMR1_REG >> 2) + i] = 0;
-    for (i = 0;
+    for (i = 0; i < NUM_PRU_CHANNELS &&
          ((prussintc_init_data->channel_to_host_map[i].channel != -1)
           && (prussintc_init_data->channel_to_host_map[i].host != -1));
          i++) {
@@ -403,7 +688,8 @@ int prussdrv_pruintc_init(const tpruss_intc_initdata *prussintc_init_data)
 
 
     mask1 = mask2 = 0;
-    for (i = 0; prussintc_init_data->sysevts_enabled[i] != 255; i++) {
+    for (i = 0; i < NUM_PRU_SYS_EVTS &&
+         (unsigned char) prussintc_init_data->sysevts_enabled[i] != 255; i++) {
         if (prussintc_init_data->sysevts_enabled[i] < 32) {
             mask1 =
                 mask1 + (1 << (prussintc_init_data->sysevts_enabled[i]));
@@ -433,40 +719,56 @@ int prussdrv_pruintc_init(const tpruss_intc_initdata *prussintc_init_data)
     memcpy( &prussdrv.intc_data, prussintc_init_data,
             sizeof(prussdrv.intc_data) );
 
+    // Precompute the lookups so that they are O(1) on the event path.
+    // Only the first mapping of an event or channel counts, as before.
+    __prussintc_reset_maps();
+    for (i = 0; i < NUM_PRU_CHANNELS &&
+                prussdrv.intc_data.channel_to_host_map[i].channel != -1 &&
+                prussdrv.intc_data.channel_to_host_map[i].host    != -1; ++i) {
+        short channel = prussdrv.intc_data.channel_to_host_map[i].channel;
+        if (channel >= 0 && channel < NUM_PRU_CHANNELS &&
+            prussdrv.channel_to_host[channel] == -1)
+            /** -2 is because first two host interrupts are reserved
+             * for PRU0 and PRU1 */
+            prussdrv.channel_to_host[channel] =
+                prussdrv.intc_data.channel_to_host_map[i].host - 2;
+    }
+    for (i = 0; i < NUM_PRU_SYS_EVTS &&
+                prussdrv.intc_data.sysevt_to_channel_map[i].sysevt  !=-1 &&
+                prussdrv.intc_data.sysevt_to_channel_map[i].channel !=-1; ++i) {
+        short sysevt = prussdrv.intc_data.sysevt_to_channel_map[i].sysevt;
+        short channel = prussdrv.intc_data.sysevt_to_channel_map[i].channel;
+        if (sysevt >= 0 && sysevt < NUM_PRU_SYS_EVTS &&
+            prussdrv.sysevt_to_channel[sysevt] == -1) {
+            prussdrv.sysevt_to_channel[sysevt] = channel;
+            if (channel >= 0 && channel < NUM_PRU_CHANNELS)
+                prussdrv.sysevt_to_host[sysevt] =
+                    prussdrv.channel_to_host[channel];
+        }
+    }
+
     return 0;
 }
 
 short prussdrv_get_event_to_channel_map( unsigned int eventnum )
 {
-    unsigned int i;
-    for (i = 0; i < NUM_PRU_SYS_EVTS &&
-                prussdrv.intc_data.sysevt_to_channel_map[i].sysevt  !=-1 &&
-                prussdrv.intc_data.sysevt_to_channel_map[i].channel !=-1; ++i) {
-        if ( eventnum == prussdrv.intc_data.sysevt_to_channel_map[i].sysevt )
-            return prussdrv.intc_data.sysevt_to_channel_map[i].channel;
-    }
-    return -1;
+    if (eventnum >= NUM_PRU_SYS_EVTS)
+        return -1;
+    return prussdrv.sysevt_to_channel[eventnum];
 }
 
 short prussdrv_get_channel_to_host_map( unsigned int channel )
 {
-    unsigned int i;
-    for (i = 0; i < NUM_PRU_CHANNELS &&
-                prussdrv.intc_data.channel_to_host_map[i].channel != -1 &&
-                prussdrv.intc_data.channel_to_host_map[i].host    != -1; ++i) {
-        if ( channel == prussdrv.intc_data.channel_to_host_map[i].channel )
-            /** -2 is because first two host interrupts are reserved
-             * for PRU0 and PRU1 */
-            return prussdrv.intc_data.channel_to_host_map[i].host - 2;
-    }
-    return -1;
+    if (channel >= NUM_PRU_CHANNELS)
+        return -1;
+    return prussdrv.channel_to_host[channel];
 }
 
 short prussdrv_get_event_to_host_map( unsigned int eventnum )
 {
-    short ans = prussdrv_get_event_to_channel_map( eventnum );
-    if (ans < 0) return ans;
-    return prussdrv_get_channel_to_host_map( ans );
+    if (eventnum >= NUM_PRU_SYS_EVTS)
+        return -1;
+    return prussdrv.sysevt_to_host[eventnum];
 }
 
 int prussdrv_pru_send_event(unsigned int eventnum)
@@ -476,13 +778,86 @@ int prussdrv_pru_send_event(unsigned int eventnum)
         pruintc_io[PRU_INTC_SRSR1_REG >> 2] = 1 << eventnum;
     else
         pruintc_io[PRU_INTC_SRSR2_REG >> 2] = 1 << (eventnum - 32);
+
+    // Stand in for the INTC routing the event to its host interrupt
+    if (prussdrv.simulated && eventnum < NUM_PRU_SYS_EVTS &&
+        prussdrv.sysevt_to_host[eventnum] >= 0 &&
+        prussdrv.sysevt_to_host[eventnum] < NUM_PRU_HOSTIRQS) {
+        pthread_mutex_lock(&sim_lock);
+        __prussdrv_sim_signal(prussdrv.sysevt_to_host[eventnum]);
+        pthread_mutex_unlock(&sim_lock);
+    }
     return 0;
 }
 
+int prussdrv_pru_read_event(unsigned int host_interrupt, unsigned int *event_count)
+{
+    if (host_interrupt >= NUM_PRU_HOSTIRQS)
+        return -1;
+
+    if (prussdrv.simulated && !prussdrv.fd_attached[host_interrupt]) {
+        // eventfds hand out 8 byte deltas, turn them into the UIO running count
+        uint64_t delta;
+        if (read(prussdrv.fd[host_interrupt], &delta, sizeof(delta)) != sizeof(delta))
+            return -1;
+        pthread_mutex_lock(&sim_lock);
+        prussdrv.sim_count[host_interrupt] += (unsigned int) delta;
+        *event_count = prussdrv.sim_count[host_interrupt];
+        pthread_mutex_unlock(&sim_lock);
+        return 0;
+    }
+
+    if (read(prussdrv.fd[host_interrupt], event_count, sizeof(*event_count)) !=
+        sizeof(*event_count))
+        return -1;
+    return 0;
+}
+
+int prussdrv_pru_wait_event_timeout(unsigned int host_interrupt,
+                                    unsigned int *event_count,
+                                    int timeout_ms, int cancel_fd)
+{
+    struct pollfd fds[2];
+    int nfds = 1, rc;
+
+    if (host_interrupt >= NUM_PRU_HOSTIRQS || prussdrv.fd[host_interrupt] <= 0) {
+        errno = EBADF;
+        return -1;
+    }
+
+    fds[0].fd = prussdrv.fd[host_interrupt];
+    fds[0].events = POLLIN;
+    if (cancel_fd >= 0) {
+        fds[1].fd = cancel_fd;
+        fds[1].events = POLLIN;
+        nfds = 2;
+    }
+
+    do {
+        rc = poll(fds, nfds, timeout_ms);
+    } while (rc < 0 && errno == EINTR);
+
+    if (rc < 0)
+        return -1;
+    if (rc == 0) {
+        errno = ETIMEDOUT;
+        return -1;
+    }
+    if (nfds == 2 && fds[1].revents) {
+        errno = ECANCELED;
+        return -1;
+    }
+    if (fds[0].revents & (POLLERR | POLLNVAL)) {
+        errno = EBADF;
+        return -1;
+    }
+    return prussdrv_pru_read_event(host_interrupt, event_count);
+}
+
 unsigned int prussdrv_pru_wait_event(unsigned int host_interrupt)
 {
-    unsigned int event_count;
-    read(prussdrv.fd[host_interrupt], &event_count, sizeof(int));
+    unsigned int event_count = 0;
+    prussdrv_pru_read_event(host_interrupt, &event_count);
     return event_count;
 }
 
@@ -494,6 +869,18 @@ int prussdrv_pru_event_fd(unsigned int host_interrupt)
         return -1;
 }
 
+int prussdrv_pru_attach_event_fd(unsigned int host_interrupt, int fd)
+{
+    if (host_interrupt >= NUM_PRU_HOSTIRQS || fd <= 0 ||
+        prussdrv.pru0_dataram_base == NULL)
+        return -1;
+    if (prussdrv.fd[host_interrupt] > 0)
+        close(prussdrv.fd[host_interrupt]);
+    prussdrv.fd[host_interrupt] = fd;
+    prussdrv.fd_attached[host_interrupt] = 1;
+    return 0;
+}
+
 int prussdrv_pru_clear_event(unsigned int host_interrupt, unsigned int sysevent)
 {
     unsigned int *pruintc_io = (unsigned int *) prussdrv.intc_base;
@@ -508,6 +895,16 @@ int prussdrv_pru_clear_event(unsigned int host_interrupt, unsigned int sysevent)
     // The +2 is because the first two host interrupts are reserved for
     // PRU0 and PRU1.
     pruintc_io[PRU_INTC_HIEISR_REG >> 2] = host_interrupt+2;
+
+    if (prussdrv.simulated && host_interrupt < NUM_PRU_HOSTIRQS) {
+        pthread_mutex_lock(&sim_lock);
+        prussdrv.sim_masked[host_interrupt] = 0;
+        if (prussdrv.sim_pending[host_interrupt]) {
+            prussdrv.sim_pending[host_interrupt] = 0;
+            __prussdrv_sim_signal(host_interrupt);
+        }
+        pthread_mutex_unlock(&sim_lock);
+    }
     return 0;
 }
 
@@ -547,6 +944,12 @@ unsigned int prussdrv_extmem_size(void)
 int prussdrv_map_prumem(unsigned int pru_ram_id, void **address)
 {
     switch (pru_ram_id) {
+    case PRUSS0_PRU0_IRAM:
+        *address = prussdrv.pru0_iram_base;
+        break;
+    case PRUSS0_PRU1_IRAM:
+        *address = prussdrv.pru1_iram_base;
+        break;
     case PRUSS0_PRU0_DATARAM:
         *address = prussdrv.pru0_dataram_base;
         break;
@@ -651,14 +1054,27 @@ void *prussdrv_get_virt_addr(unsigned int phyaddr)
 
 int prussdrv_exit()
 {
-    int i;
-    munmap(prussdrv.pru0_dataram_base, prussdrv.pruss_map_size);
-    munmap(prussdrv.l3ram_base, prussdrv.l3ram_map_size);
-    munmap(prussdrv.extram_base, prussdrv.extram_map_size);
+    int i, simulated;
+    if (prussdrv.simulated) {
+        // One mapping holds both the PRUSS and the external RAM
+        if (prussdrv.pru0_dataram_base)
+            munmap(prussdrv.pru0_dataram_base,
+                   prussdrv.pruss_map_size + prussdrv.extram_map_size);
+        if (prussdrv.sim_memfd > 0)
+            close(prussdrv.sim_memfd);
+    } else {
+        munmap(prussdrv.pru0_dataram_base, prussdrv.pruss_map_size);
+        munmap(prussdrv.l3ram_base, prussdrv.l3ram_map_size);
+        munmap(prussdrv.extram_base, prussdrv.extram_map_size);
+    }
     for (i = 0; i < NUM_PRU_HOSTIRQS; i++) {
         if (prussdrv.fd[i])
             close(prussdrv.fd[i]);
     }
+    // Forget the fds and the mapping, so a late call fails instead of using them
+    simulated = prussdrv.simulated;
+    memset(&prussdrv, 0, sizeof(prussdrv));
+    prussdrv.simulated = simulated;
     return 0;
 }
 
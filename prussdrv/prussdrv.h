@@ -77,6 +77,24 @@ extern "C" {
 #define	PRUSS0_MDIO            10
 //Available in AM33xx series - end
 
+// PRU control registers, as byte offsets from prussdrv_map_pru_control()
+#define PRU_CONTROL_REG         0x00
+#define PRU_STATUS_REG          0x04
+#define PRU_WAKEUP_EN_REG       0x08
+#define PRU_CYCLE_REG           0x0C
+#define PRU_STALL_REG           0x10
+
+// Bits of PRU_CONTROL_REG, PCTR_RST_VAL (start address in words) is in bits 16..31
+#define PRU_CONTROL_SOFT_RST_N      (1 << 0)
+#define PRU_CONTROL_ENABLE          (1 << 1)
+#define PRU_CONTROL_SLEEPING        (1 << 2)
+#define PRU_CONTROL_COUNTER_ENABLE  (1 << 3)
+#define PRU_CONTROL_SINGLE_STEP     (1 << 8)
+#define PRU_CONTROL_RUNSTATE        (1 << 15)
+
+// PRU_STATUS_REG holds the program counter, in words
+#define PRU_STATUS_PCOUNTER_MASK    0xFFFF
+
 #define PRU_EVTOUT_0            0
 #define PRU_EVTOUT_1            1
 #define PRU_EVTOUT_2            2
@@ -112,6 +130,14 @@ extern "C" {
 
     int prussdrv_open(unsigned int host_interrupt);
 
+    /** Use a simulated PRUSS instead of /dev/uioN, backed by a memfd and
+     * eventfds. Call after prussdrv_init() and before the first
+     * prussdrv_open(). Setting PRUSS_SIMULATOR=1 in the environment has the
+     * same effect. @return -1 if the PRUSS is already mapped. */
+    int prussdrv_simulate(int enable);
+
+    int prussdrv_is_simulated(void);
+
     /** Return version of PRU.  This must be called after prussdrv_open. */
     int prussdrv_version();
 
@@ -163,10 +189,42 @@ extern "C" {
 
     unsigned int prussdrv_extmem_size(void);
 
+    /** IRAM is only accessible while its PRU is disabled. */
     int prussdrv_map_prumem(unsigned int pru_ram_id, void **address);
 
     int prussdrv_map_peripheral_io(unsigned int per_id, void **address);
 
+    /** Stop a PRU after its current instruction, keeping its program counter,
+     * registers and memory. @return -1 with errno ETIMEDOUT if it didn't stop. */
+    int prussdrv_pru_halt(unsigned int prunum);
+
+    /** Let a halted PRU continue where it stopped, unlike
+     * prussdrv_pru_enable_at() which resets it first. */
+    int prussdrv_pru_resume(unsigned int prunum);
+
+    /** Execute count instructions of a halted PRU, one at a time.
+     * @return -1 with errno EBUSY if it is running. */
+    int prussdrv_pru_step(unsigned int prunum, unsigned int count);
+
+    /** Map the control registers (PRU_*_REG) or the debug registers (r0..r31
+     * at word 0..31, readable while the PRU is halted) of a PRU. */
+    int prussdrv_map_pru_control(unsigned int prunum, void **address);
+
+    int prussdrv_map_pru_debug(unsigned int prunum, void **address);
+
+    /** Clear then set bits of PRU_CONTROL_REG. Every control register write
+     * of the driver is serialized, so threads driving a PRU don't undo each
+     * other's writes. The PRU itself clears ENABLE on HALT, which a concurrent
+     * update can undo: only use it to drive a PRU, not from a background
+     * thread. @return the new value, or -1. */
+    int prussdrv_pru_update_control(unsigned int prunum, unsigned int clear,
+                                    unsigned int set);
+
+    /** Zero the CYCLE and STALL counters, which stop rather than wrap once
+     * CYCLE reaches 0xFFFFFFFF, and let them count. Rewrites CONTROL, with
+     * the same caveat as prussdrv_pru_update_control(). */
+    int prussdrv_pru_reset_counters(unsigned int prunum);
+
     unsigned int prussdrv_get_phys_addr(const void *address);
 
     void *prussdrv_get_virt_addr(unsigned int phyaddr);
@@ -175,8 +233,26 @@ extern "C" {
      * @return the number of times the event has happened. */
     unsigned int prussdrv_pru_wait_event(unsigned int host_interrupt);
 
+    /** Read the running count of the specified host interrupt, blocking
+     * until it fires. @return 0 on success, -1 on error. */
+    int prussdrv_pru_read_event(unsigned int host_interrupt, unsigned int *event_count);
+
+    /** Wait for the specified host interrupt for at most timeout_ms
+     * milliseconds (-1 for no limit), or until cancel_fd (-1 for none)
+     * becomes readable. @return 0 with the running count on success, -1 with
+     * errno set to ETIMEDOUT, ECANCELED or the error otherwise. */
+    int prussdrv_pru_wait_event_timeout(unsigned int host_interrupt,
+                                        unsigned int *event_count,
+                                        int timeout_ms, int cancel_fd);
+
     int prussdrv_pru_event_fd(unsigned int host_interrupt);
 
+    /** Read a host interrupt from fd instead of /dev/uioN, once the driver is
+     * open. Each read() must return the 4 byte running count, as UIO does, so
+     * a pipe written by a test can stand in for the hardware. The driver takes
+     * fd over and closes it in prussdrv_exit(). @return 0, or -1. */
+    int prussdrv_pru_attach_event_fd(unsigned int host_interrupt, int fd);
+
     int prussdrv_pru_send_event(unsigned int eventnum);
 
     /** Clear the specified event and re-enable the host interrupt. */
@@ -0,0 +1,253 @@
+//PRU Driver headers
+#include <pruss_copy.h>
+
+//Node.js addon headers
+#include <node_buffer.h>
+#include <nan.h>
+
+#include "memory.h"
+#include "batch.h"
+#include "context.h"
+
+using namespace v8;
+
+/* Parse an array of {region, offset, length} into segments
+ *	Returns false with a pending exception on invalid input
+ */
+bool parseSegments(Local<Value> value, std::vector<Segment>& segments, uint32_t* totalLength) {
+	if (!value->IsArray()) {
+		Nan::ThrowTypeError("Transfers must be an array of {region, offset, length}");
+		return false;
+	}
+	
+	Local<Array> a = Local<Array>::Cast(value);
+	Local<String> regionKey = Nan::New("region").ToLocalChecked();
+	Local<String> offsetKey = Nan::New("offset").ToLocalChecked();
+	Local<String> lengthKey = Nan::New("length").ToLocalChecked();
+	uint64_t total = 0;
+	
+	segments.resize(a->Length());
+	for (unsigned int i = 0; i < a->Length(); i++) {
+		Local<Value> element = a->Get(i);
+		if (!element->IsObject()) {
+			Nan::ThrowTypeError("Transfers must be an array of {region, offset, length}");
+			return false;
+		}
+		
+		Local<Object> o = element->ToObject();
+		Local<Value> region = Nan::Get(o, regionKey).ToLocalChecked();
+		Local<Value> offset = Nan::Get(o, offsetKey).ToLocalChecked();
+		Local<Value> length = Nan::Get(o, lengthKey).ToLocalChecked();
+		if (!region->IsNumber() || !offset->IsNumber() || !length->IsNumber()) {
+			Nan::ThrowTypeError("region, offset and length must be Integer");
+			return false;
+		}
+		
+		segments[i].region = region->Uint32Value();
+		segments[i].offset = offset->Uint32Value();
+		segments[i].length = length->Uint32Value();
+		if (!inRegion(segments[i].region, segments[i].offset, segments[i].length)) {
+			Nan::ThrowRangeError("Transfer out of range of its region, or region not mapped");
+			return false;
+		}
+		total += segments[i].length;
+	}
+	
+	if (total > node::Buffer::kMaxLength) {
+		Nan::ThrowRangeError("Transfers are too large for a single Buffer");
+		return false;
+	}
+	
+	*totalLength = (uint32_t) total;
+	return true;
+}
+
+static void readSegments(const std::vector<Segment>& segments, char* out) {
+	for (size_t i = 0; i < segments.size(); i++) {
+		const Segment& s = segments[i];
+		pruss_copy_from_device(out, memRegions[s.region].base + s.offset, s.length);
+		out += s.length;
+	}
+}
+
+static void writeSegments(const std::vector<Segment>& segments, const char* in) {
+	for (size_t i = 0; i < segments.size(); i++) {
+		const Segment& s = segments[i];
+		pruss_copy_to_device(memRegions[s.region].base + s.offset, in, s.length);
+		in += s.length;
+	}
+}
+
+/* Check an optional Buffer argument holds at least length bytes
+ *	Returns false with a pending exception otherwise
+ */
+static bool checkBuffer(Local<Value> value, uint32_t length) {
+	if (!node::Buffer::HasInstance(value)) {
+		Nan::ThrowTypeError("Argument must be a Buffer");
+		return false;
+	}
+	if (node::Buffer::Length(value) < length) {
+		Nan::ThrowRangeError("Buffer is smaller than the transfers");
+		return false;
+	}
+	return true;
+}
+
+void AccessPlan::Init() {
+	Local<FunctionTemplate> tpl = Nan::New<FunctionTemplate>(New);
+	tpl->SetClassName(Nan::New("AccessPlan").ToLocalChecked());
+	tpl->InstanceTemplate()->SetInternalFieldCount(1);
+	
+	Nan::SetPrototypeMethod(tpl, "read", Read);
+	Nan::SetPrototypeMethod(tpl, "write", Write);
+	
+	currentEnv()->planConstructor.Reset(Nan::GetFunction(tpl).ToLocalChecked());
+}
+
+NAN_METHOD(AccessPlan::New) {
+	AccessPlan* obj = new AccessPlan();
+	obj->Wrap(info.This());
+	info.GetReturnValue().Set(info.This());
+}
+
+Local<Value> AccessPlan::NewInstance(Local<Value> list) {
+	Nan::EscapableHandleScope scope;
+	
+	Local<Object> instance = Nan::NewInstance(Nan::New(currentEnv()->planConstructor)).ToLocalChecked();
+	AccessPlan* obj = Nan::ObjectWrap::Unwrap<AccessPlan>(instance);
+	if (!parseSegments(list, obj->segments, &obj->totalLength)) {
+		return scope.Escape(Nan::Undefined());
+	}
+	obj->generation = mappingGeneration;
+	obj->output.Reset(Nan::NewBuffer(obj->totalLength).ToLocalChecked());
+	
+	Nan::Set(instance, Nan::New("length").ToLocalChecked(), Nan::New<Number>(obj->totalLength));
+	return scope.Escape(instance);
+}
+
+bool AccessPlan::Check() {
+	if (generation == mappingGeneration) {
+		return true;
+	}
+	
+	for (size_t i = 0; i < segments.size(); i++) {
+		if (!inRegion(segments[i].region, segments[i].offset, segments[i].length)) {
+			Nan::ThrowError("PRU memory is no longer mapped for this plan");
+			return false;
+		}
+	}
+	generation = mappingGeneration;
+	return true;
+}
+
+/* Run all reads of the plan
+ *	Fills and returns the plan's own Buffer, the same one on every call, unless
+ *	another Buffer is passed in.
+ *
+ *	@param {Buffer} [out]
+ */
+NAN_METHOD(AccessPlan::Read) {
+	Nan::HandleScope scope;
+	AccessPlan* obj = Nan::ObjectWrap::Unwrap<AccessPlan>(info.Holder());
+	
+	Local<Object> out = Nan::New(obj->output);
+	if (info.Length() > 0) {
+		if (!checkBuffer(info[0], obj->totalLength)) {
+			return;
+		}
+		out = info[0].As<Object>();
+	}
+	
+	if (!obj->Check()) {
+		return;
+	}
+	
+	readSegments(obj->segments, node::Buffer::Data(out));
+	info.GetReturnValue().Set(out);
+}
+
+/* Run all writes of the plan, taking the data back to back from a Buffer
+ *
+ *	@param {Buffer} data
+ */
+NAN_METHOD(AccessPlan::Write) {
+	Nan::HandleScope scope;
+	AccessPlan* obj = Nan::ObjectWrap::Unwrap<AccessPlan>(info.Holder());
+	
+	if (info.Length() != 1) {
+		return Nan::ThrowTypeError("Wrong number of arguments");
+	}
+	
+	if (!checkBuffer(info[0], obj->totalLength) || !obj->Check()) {
+		return;
+	}
+	
+	writeSegments(obj->segments, node::Buffer::Data(info[0]));
+}
+
+/* Read a list of ranges into one Buffer
+ *
+ *	@param {object[]} transfers [{region, offset, length}, ...]
+ *	@param {Buffer} [out] Buffer to fill instead of allocating one
+ */
+NAN_METHOD(readv) {
+	Nan::HandleScope scope;
+	std::vector<Segment> segments;
+	uint32_t totalLength;
+	
+	if (info.Length() < 1 || info.Length() > 2) {
+		return Nan::ThrowTypeError("Wrong number of arguments");
+	}
+	
+	if (!parseSegments(info[0], segments, &totalLength)) {
+		return;
+	}
+	
+	Local<Object> out;
+	if (info.Length() > 1) {
+		if (!checkBuffer(info[1], totalLength)) {
+			return;
+		}
+		out = info[1].As<Object>();
+	} else {
+		out = Nan::NewBuffer(totalLength).ToLocalChecked();
+	}
+	
+	readSegments(segments, node::Buffer::Data(out));
+	info.GetReturnValue().Set(out);
+}
+
+/* Write a list of ranges, taking the data back to back from one Buffer
+ *
+ *	@param {object[]} transfers [{region, offset, length}, ...]
+ *	@param {Buffer} data
+ */
+NAN_METHOD(writev) {
+	Nan::HandleScope scope;
+	std::vector<Segment> segments;
+	uint32_t totalLength;
+	
+	if (info.Length() != 2) {
+		return Nan::ThrowTypeError("Wrong number of arguments");
+	}
+	
+	if (!parseSegments(info[0], segments, &totalLength) || !checkBuffer(info[1], totalLength)) {
+		return;
+	}
+	
+	writeSegments(segments, node::Buffer::Data(info[1]));
+}
+
+/* Compile a list of ranges into a reusable plan
+ *
+ *	@param {object[]} transfers [{region, offset, length}, ...]
+ */
+NAN_METHOD(createPlan) {
+	Nan::HandleScope scope;
+	
+	if (info.Length() != 1) {
+		return Nan::ThrowTypeError("Wrong number of arguments");
+	}
+	
+	info.GetReturnValue().Set(AccessPlan::NewInstance(info[0]));
+}
@@ -0,0 +1,49 @@
+#ifndef _BATCH_H
+#define _BATCH_H
+
+#include <vector>
+#include <stdint.h>
+
+#include <nan.h>
+
+//One contiguous transfer of a batch
+struct Segment {
+	unsigned int region;
+	uint32_t offset;
+	uint32_t length;
+};
+
+//Parse an array of {region, offset, length} into segments
+//Returns false with a pending exception on invalid input
+bool parseSegments(v8::Local<v8::Value> value, std::vector<Segment>& segments, uint32_t* totalLength);
+
+/* Precompiled list of transfers, reusable across calls
+ *	Descriptors are parsed and validated once, and reads go to one preallocated Buffer.
+ */
+class AccessPlan : public Nan::ObjectWrap {
+public:
+	static void Init();
+	
+	//Create a plan from an array of {region, offset, length}
+	//Returns an empty handle with a pending exception on failure
+	static v8::Local<v8::Value> NewInstance(v8::Local<v8::Value> list);
+	
+private:
+	static NAN_METHOD(New);
+	static NAN_METHOD(Read);
+	static NAN_METHOD(Write);
+	
+	//Revalidate the segments if the mapping changed since they were checked
+	bool Check();
+	
+	std::vector<Segment> segments;
+	uint32_t totalLength;
+	unsigned int generation;
+	Nan::Persistent<v8::Object> output;
+};
+
+NAN_METHOD(readv);
+NAN_METHOD(writev);
+NAN_METHOD(createPlan);
+
+#endif
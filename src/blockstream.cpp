@@ -0,0 +1,205 @@
+//Node.js addon headers
+#include <nan.h>
+
+//PRU Driver headers
+#include <prussdrv.h>
+
+#include "memory.h"
+#include "blockstream.h"
+#include "context.h"
+
+using namespace v8;
+
+/* filled is written by the PRU behind the compiler's back, so it is loaded with acquire
+ * semantics before the block is read, and released is stored with release semantics once
+ * JS is done with it, as for the ring buffer.
+ */
+static inline uint32_t loadAcquire(volatile uint32_t* p) {
+	return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static inline void storeRelease(volatile uint32_t* p, uint32_t v) {
+	__atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+void BlockReader::Init() {
+	Local<FunctionTemplate> tpl = Nan::New<FunctionTemplate>(New);
+	tpl->SetClassName(Nan::New("BlockReader").ToLocalChecked());
+	tpl->InstanceTemplate()->SetInternalFieldCount(1);
+	
+	Nan::SetPrototypeMethod(tpl, "next", Next);
+	Nan::SetPrototypeMethod(tpl, "release", Release);
+	Nan::SetPrototypeMethod(tpl, "available", Available);
+	
+	currentEnv()->blockReaderConstructor.Reset(Nan::GetFunction(tpl).ToLocalChecked());
+}
+
+NAN_METHOD(BlockReader::New) {
+	BlockReader* obj = new BlockReader();
+	obj->Wrap(info.This());
+	info.GetReturnValue().Set(info.This());
+}
+
+Local<Object> BlockReader::NewInstance(struct pru_stream* stream, unsigned int generation) {
+	Nan::EscapableHandleScope scope;
+	
+	Local<Object> instance = Nan::NewInstance(Nan::New(currentEnv()->blockReaderConstructor)).ToLocalChecked();
+	BlockReader* obj = Nan::ObjectWrap::Unwrap<BlockReader>(instance);
+	obj->stream = stream;
+	obj->generation = generation;
+	
+	Nan::Set(instance, Nan::New("blocks").ToLocalChecked(), Nan::New<Number>(stream->block_count));
+	Nan::Set(instance, Nan::New("blockSize").ToLocalChecked(), Nan::New<Number>(stream->block_size));
+	Nan::Set(instance, Nan::New("address").ToLocalChecked(), Nan::New<Number>(stream->data_addr));
+	return scope.Escape(instance);
+}
+
+BlockReader* BlockReader::Check(Nan::NAN_METHOD_ARGS_TYPE info) {
+	BlockReader* obj = Nan::ObjectWrap::Unwrap<BlockReader>(info.Holder());
+	if (obj->generation != mappingGeneration) {
+		Nan::ThrowError("PRU memory was unmapped, the block stream is no longer valid");
+		return NULL;
+	}
+	return obj;
+}
+
+uint32_t BlockReader::available() const {
+	uint32_t count = loadAcquire(&stream->filled) - stream->released;
+	return count > stream->block_count ? stream->block_count + 1 : count;
+}
+
+/* Index of the oldest filled block, -1 if the PRU has not filled one
+ *	The block stays with the host, and the same index is returned, until release()
+ */
+NAN_METHOD(BlockReader::Next) {
+	Nan::HandleScope scope;
+	
+	BlockReader* obj = Check(info);
+	if (obj == NULL) {
+		return;
+	}
+	
+	uint32_t available = obj->available();
+	if (available > obj->stream->block_count) {
+		return Nan::ThrowError("Block stream header is corrupt");
+	}
+	
+	int32_t index = available == 0 ? -1 : (int32_t) (obj->stream->released & (obj->stream->block_count - 1));
+	info.GetReturnValue().Set(Nan::New<Number>(index));
+}
+
+/* Hand blocks back to the PRU, oldest first
+ *	Their memory must not be read afterwards, the PRU is free to overwrite it
+ *
+ *	@param {number} [count] number of blocks, defaults to 1
+ */
+NAN_METHOD(BlockReader::Release) {
+	Nan::HandleScope scope;
+	
+	if (info.Length() > 1 || (info.Length() == 1 && !info[0]->IsNumber())) {
+		return Nan::ThrowTypeError("Argument must be Integer");
+	}
+	
+	BlockReader* obj = Check(info);
+	if (obj == NULL) {
+		return;
+	}
+	
+	uint32_t count = info.Length() == 1 ? info[0]->Uint32Value() : 1;
+	if (count > obj->available()) {
+		return Nan::ThrowRangeError("Cannot release more blocks than were filled");
+	}
+	
+	storeRelease(&obj->stream->released, obj->stream->released + count);
+}
+
+/* Number of filled blocks waiting to be read */
+NAN_METHOD(BlockReader::Available) {
+	Nan::HandleScope scope;
+	
+	BlockReader* obj = Check(info);
+	if (obj == NULL) {
+		return;
+	}
+	
+	info.GetReturnValue().Set(Nan::New<Number>(obj->available()));
+}
+
+/* Set up a block stream from the PRU
+ *	Writes a fresh control header at offset, with blocks blocks of blockSize bytes
+ *	starting at dataOffset in dataRegion. The data area defaults to the whole of the
+ *	external memory, split in two for ping-pong buffering.
+ *
+ *	@param {object} options { region, offset, dataRegion, dataOffset, blocks, blockSize }
+ */
+NAN_METHOD(createBlockReader) {
+	Nan::HandleScope scope;
+	char* base;
+	size_t size;
+	char* dataBase;
+	size_t dataSize;
+	
+	if (info.Length() != 1 || !info[0]->IsObject()) {
+		return Nan::ThrowTypeError("Argument must be an options object");
+	}
+	
+	Local<Object> options = info[0]->ToObject();
+	Local<Value> region = Nan::Get(options, Nan::New("region").ToLocalChecked()).ToLocalChecked();
+	Local<Value> offset = Nan::Get(options, Nan::New("offset").ToLocalChecked()).ToLocalChecked();
+	Local<Value> dataRegion = Nan::Get(options, Nan::New("dataRegion").ToLocalChecked()).ToLocalChecked();
+	Local<Value> dataOffset = Nan::Get(options, Nan::New("dataOffset").ToLocalChecked()).ToLocalChecked();
+	Local<Value> blocks = Nan::Get(options, Nan::New("blocks").ToLocalChecked()).ToLocalChecked();
+	Local<Value> blockSize = Nan::Get(options, Nan::New("blockSize").ToLocalChecked()).ToLocalChecked();
+	
+	if (!region->IsNumber() || !getRegion(region->Uint32Value(), &base, &size)) {
+		return Nan::ThrowError("region must be a mapped memory region, did you call init()?");
+	}
+	
+	uint32_t offsetI = offset->IsUndefined() ? 0 : offset->Uint32Value();
+	if (!(offset->IsUndefined() || offset->IsNumber()) || (offsetI & 3) != 0 || !inRegion(region->Uint32Value(), offsetI, PRU_STREAM_HEADER_SIZE)) {
+		return Nan::ThrowRangeError("offset must be 4 byte aligned and inside the region");
+	}
+	
+	uint32_t dataRegionI = dataRegion->IsUndefined() ? REGION_EXTRAM : dataRegion->Uint32Value();
+	if (!(dataRegion->IsUndefined() || dataRegion->IsNumber()) || !getRegion(dataRegionI, &dataBase, &dataSize)) {
+		return Nan::ThrowError("dataRegion must be a mapped memory region");
+	}
+	
+	uint32_t dataOffsetI = dataOffset->IsUndefined() ? 0 : dataOffset->Uint32Value();
+	if (!(dataOffset->IsUndefined() || dataOffset->IsNumber()) || (dataOffsetI & 3) != 0 || !inRegion(dataRegionI, dataOffsetI, 0)) {
+		return Nan::ThrowRangeError("dataOffset must be 4 byte aligned and inside the region");
+	}
+	
+	uint32_t blocksI = blocks->IsUndefined() ? 2 : blocks->Uint32Value();
+	if (!(blocks->IsUndefined() || blocks->IsNumber()) || blocksI == 0 || (blocksI & (blocksI - 1)) != 0) {
+		return Nan::ThrowRangeError("blocks must be a power of two");
+	}
+	
+	uint32_t blockSizeI = blockSize->IsUndefined() ? (uint32_t) ((dataSize - dataOffsetI) / blocksI) & ~3u : blockSize->Uint32Value();
+	if (!(blockSize->IsUndefined() || blockSize->IsNumber()) || blockSizeI == 0 || (blockSizeI & 3) != 0) {
+		return Nan::ThrowRangeError("blockSize must be a multiple of 4");
+	}
+	if (!inRegion(dataRegionI, dataOffsetI, (uint64_t) blocksI * blockSizeI)) {
+		return Nan::ThrowRangeError("Blocks do not fit in the data region");
+	}
+	
+	char* data = dataBase + dataOffsetI;
+	if (base + offsetI < data + (size_t) blocksI * blockSizeI && data < base + offsetI + PRU_STREAM_HEADER_SIZE) {
+		return Nan::ThrowRangeError("The header overlaps the blocks");
+	}
+	
+	struct pru_stream* stream = (struct pru_stream*) (base + offsetI);
+	stream->block_count = blocksI;
+	stream->block_size = blockSizeI;
+	stream->data_addr = prussdrv_get_phys_addr(data);
+	stream->flags = 0;
+	stream->released = 0;
+	storeRelease(&stream->filled, 0);
+	
+	Local<Object> reader = BlockReader::NewInstance(stream, mappingGeneration);
+	Nan::Set(reader, Nan::New("region").ToLocalChecked(), Nan::New<Number>(region->Uint32Value()));
+	Nan::Set(reader, Nan::New("offset").ToLocalChecked(), Nan::New<Number>(offsetI));
+	Nan::Set(reader, Nan::New("dataRegion").ToLocalChecked(), Nan::New<Number>(dataRegionI));
+	Nan::Set(reader, Nan::New("dataOffset").ToLocalChecked(), Nan::New<Number>(dataOffsetI));
+	info.GetReturnValue().Set(reader);
+}
@@ -0,0 +1,37 @@
+#ifndef _BLOCKSTREAM_H
+#define _BLOCKSTREAM_H
+
+#include <nan.h>
+
+#include <pru_stream.h>
+
+/* JS handle on a PRU to host block stream, see firmware/pru_stream.h
+ *	Only tracks the control header, the blocks themselves are read through
+ *	zero-copy views of the data region.
+ */
+class BlockReader : public Nan::ObjectWrap {
+public:
+	static void Init();
+	
+	//Create a handle, returns an empty handle with a pending exception on failure
+	static v8::Local<v8::Object> NewInstance(struct pru_stream* stream, unsigned int generation);
+	
+private:
+	static NAN_METHOD(New);
+	static NAN_METHOD(Next);
+	static NAN_METHOD(Release);
+	static NAN_METHOD(Available);
+	
+	//Unwrap this and check the mapping is still the one the stream was created on
+	static BlockReader* Check(Nan::NAN_METHOD_ARGS_TYPE info);
+	
+	//Number of filled blocks the host holds, or block_count + 1 if the PRU corrupted filled
+	uint32_t available() const;
+	
+	struct pru_stream* stream;
+	unsigned int generation;
+};
+
+NAN_METHOD(createBlockReader);
+
+#endif
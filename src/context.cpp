@@ -0,0 +1,261 @@
+//System headers
+#include <string>
+
+//Node.js addon headers
+#include <node.h>
+#include <node_version.h>
+#include <uv.h>
+#include <nan.h>
+
+#include "memory.h"
+#include "interrupts.h"
+#include "ring.h"
+#include "blockstream.h"
+#include "batch.h"
+#include "loader.h"
+#include "control.h"
+#include "seqlock.h"
+#include "watch.h"
+#include "session.h"
+#include "context.h"
+
+using namespace v8;
+
+//Defined with the module-level API in prussdrv.cpp
+NAN_METHOD(isSimulated);
+NAN_METHOD(loadDatafile);
+NAN_METHOD(executeProgram);
+NAN_METHOD(setSharedRAMOffset);
+NAN_METHOD(getSharedRAMOffset);
+NAN_METHOD(getSharedRAM);
+NAN_METHOD(setSharedRAM);
+NAN_METHOD(getSharedRAMInt);
+NAN_METHOD(getSharedRAMByte);
+NAN_METHOD(getDataRAMInt);
+NAN_METHOD(getDataRAMByte);
+NAN_METHOD(setSharedRAMInt);
+NAN_METHOD(setSharedRAMByte);
+NAN_METHOD(setDataRAMInt);
+NAN_METHOD(setDataRAMByte);
+NAN_METHOD(waitForInterrupt);
+NAN_METHOD(clearInterrupt);
+NAN_METHOD(interruptPRU);
+
+//Each isolate runs on a thread of its own, so the thread finds its state without a lookup
+static __thread AddonEnv* threadEnv = NULL;
+
+//Close the handles of the thread, on its own loop
+static void closeHandles(AddonEnv* env) {
+	stopInterruptWatchers(env->loop);
+	closeWatches(env->loop);
+	cancelPendingWaits(env->loop);
+}
+
+void releaseThread(AddonEnv* env) {
+	closeHandles(env);
+	invalidateMappedViews();
+}
+
+/* The thread is going away, a worker that exited or the process
+ *	JS no longer runs, so views are dropped rather than detached, and the references
+ *	a context forgot to close() are released here.
+ */
+static void destroyEnv(void* arg) {
+	AddonEnv* env = static_cast<AddonEnv*>(arg);
+	
+	closeHandles(env);
+	for (; env->refs > 0; env->refs--) {
+		releaseSession();
+	}
+	
+	for (unsigned int i = 0; i < NUM_REGIONS; i++) {
+		env->mappedViews[i].Reset();
+	}
+	env->ringConstructor.Reset();
+	env->blockReaderConstructor.Reset();
+	env->planConstructor.Reset();
+	env->pruTemplate.Reset();
+	
+	if (threadEnv == env) {
+		threadEnv = NULL;
+	}
+	delete env;
+}
+
+AddonEnv* createEnv() {
+	AddonEnv* env = new AddonEnv();
+	env->loop = Nan::GetCurrentEventLoop();
+	env->sharedRamOffset = OFFSET_SHAREDRAM_DEFAULT;
+	env->initialised = false;
+	env->refs = 0;
+#if NODE_VERSION_AT_LEAST(10, 2, 0)
+	node::AddEnvironmentCleanupHook(Isolate::GetCurrent(), destroyEnv, env);
+#endif
+	threadEnv = env;
+	return env;
+}
+
+AddonEnv* currentEnv() {
+	return threadEnv;
+}
+
+bool threadHoldsDriver() {
+	return threadEnv != NULL && threadEnv->refs > 0;
+}
+
+bool openSession(AddonEnv* env, const SessionOptions& options, std::string* error) {
+	if (!acquireSession(options, error)) {
+		return false;
+	}
+	env->refs++;
+	return true;
+}
+
+void closeSession(AddonEnv* env) {
+	if (env->refs == 0) {
+		return;
+	}
+	
+	if (--env->refs == 0) {
+		releaseThread(env);
+	}
+	releaseSession();
+}
+
+void Pru::Init(Local<Object> target) {
+	Local<FunctionTemplate> tpl = Nan::New<FunctionTemplate>(New);
+	tpl->SetClassName(Nan::New("Pru").ToLocalChecked());
+	tpl->InstanceTemplate()->SetInternalFieldCount(1);
+	
+	Nan::SetPrototypeMethod(tpl, "close", Close);
+	Nan::SetPrototypeMethod(tpl, "isSimulated", isSimulated);
+	
+	//	Firmware
+	Nan::SetPrototypeMethod(tpl, "loadDatafile", loadDatafile);
+	Nan::SetPrototypeMethod(tpl, "execute", executeProgram);
+	Nan::SetPrototypeMethod(tpl, "loadDatafileAsync", loadDatafileAsync);
+	Nan::SetPrototypeMethod(tpl, "executeAsync", executeAsync);
+	Nan::SetPrototypeMethod(tpl, "halt", halt);
+	Nan::SetPrototypeMethod(tpl, "resume", resume);
+	Nan::SetPrototypeMethod(tpl, "step", step);
+	Nan::SetPrototypeMethod(tpl, "reset", resetPRU);
+	Nan::SetPrototypeMethod(tpl, "getState", getState);
+	
+	//	Memory, at the shared RAM offset of the context
+	Nan::SetPrototypeMethod(tpl, "getSharedRAMOffset", getSharedRAMOffset);
+	Nan::SetPrototypeMethod(tpl, "setSharedRAMOffset", setSharedRAMOffset);
+	Nan::SetPrototypeMethod(tpl, "getSharedRAM", getSharedRAM);
+	Nan::SetPrototypeMethod(tpl, "setSharedRAM", setSharedRAM);
+	Nan::SetPrototypeMethod(tpl, "getSharedRAMInt", getSharedRAMInt);
+	Nan::SetPrototypeMethod(tpl, "getSharedRAMByte", getSharedRAMByte);
+	Nan::SetPrototypeMethod(tpl, "setSharedRAMInt", setSharedRAMInt);
+	Nan::SetPrototypeMethod(tpl, "setSharedRAMByte", setSharedRAMByte);
+	Nan::SetPrototypeMethod(tpl, "getDataRAMInt", getDataRAMInt);
+	Nan::SetPrototypeMethod(tpl, "getDataRAMByte", getDataRAMByte);
+	Nan::SetPrototypeMethod(tpl, "setDataRAMInt", setDataRAMInt);
+	Nan::SetPrototypeMethod(tpl, "setDataRAMByte", setDataRAMByte);
+	
+	//	Memory, by region
+	Nan::SetPrototypeMethod(tpl, "mapSharedRAM", mapSharedRAM);
+	Nan::SetPrototypeMethod(tpl, "mapDataRAM", mapDataRAM);
+	Nan::SetPrototypeMethod(tpl, "mapExtRAM", mapExtRAM);
+	Nan::SetPrototypeMethod(tpl, "getPhysAddr", getPhysAddr);
+	Nan::SetPrototypeMethod(tpl, "readUInt8", readUInt8);
+	Nan::SetPrototypeMethod(tpl, "readUInt16", readUInt16);
+	Nan::SetPrototypeMethod(tpl, "readUInt32", readUInt32);
+	Nan::SetPrototypeMethod(tpl, "readInt32", readInt32);
+	Nan::SetPrototypeMethod(tpl, "readFloat", readFloat);
+	Nan::SetPrototypeMethod(tpl, "readUInt64", readUInt64);
+	Nan::SetPrototypeMethod(tpl, "readInt64", readInt64);
+	Nan::SetPrototypeMethod(tpl, "writeUInt8", writeUInt8);
+	Nan::SetPrototypeMethod(tpl, "writeUInt16", writeUInt16);
+	Nan::SetPrototypeMethod(tpl, "writeUInt32", writeUInt32);
+	Nan::SetPrototypeMethod(tpl, "writeInt32", writeInt32);
+	Nan::SetPrototypeMethod(tpl, "writeFloat", writeFloat);
+	Nan::SetPrototypeMethod(tpl, "readv", readv);
+	Nan::SetPrototypeMethod(tpl, "writev", writev);
+	Nan::SetPrototypeMethod(tpl, "createPlan", createPlan);
+	Nan::SetPrototypeMethod(tpl, "snapshot", snapshot);
+	Nan::SetPrototypeMethod(tpl, "watch", watch);
+	Nan::SetPrototypeMethod(tpl, "createRing", createRing);
+	Nan::SetPrototypeMethod(tpl, "createBlockReader", createBlockReader);
+	
+	//	Interrupts
+	Nan::SetPrototypeMethod(tpl, "waitForInterrupt", waitForInterrupt);
+	Nan::SetPrototypeMethod(tpl, "onInterrupt", onInterrupt);
+	Nan::SetPrototypeMethod(tpl, "offInterrupt", offInterrupt);
+	Nan::SetPrototypeMethod(tpl, "clearInterrupt", clearInterrupt);
+	Nan::SetPrototypeMethod(tpl, "interrupt", interruptPRU);
+	
+	currentEnv()->pruTemplate.Reset(tpl);
+	Nan::Set(target, Nan::New("Pru").ToLocalChecked(), Nan::GetFunction(tpl).ToLocalChecked());
+}
+
+unsigned int* Pru::SharedRAMOffset(Nan::NAN_METHOD_ARGS_TYPE info) {
+	AddonEnv* env = currentEnv();
+	if (Nan::New(env->pruTemplate)->HasInstance(info.Holder())) {
+		return &Nan::ObjectWrap::Unwrap<Pru>(info.Holder())->sharedRamOffset;
+	}
+	return &env->sharedRamOffset;
+}
+
+/* Open a context
+ *	Takes the same argument as init(), plus sharedRAMOffset. The first context, or init(),
+ *	to open the driver configures the INTC; later ones may add host interrupts, but must
+ *	leave the mapping alone or ask for the same one.
+ *	A context holds the driver open until close(), or until its thread exits.
+ *
+ *	@param {number[]|object} [hosts] host interrupts to open, or options as for init()
+ */
+NAN_METHOD(Pru::New) {
+	Nan::HandleScope scope;
+	SessionOptions options;
+	unsigned int offset = OFFSET_SHAREDRAM_DEFAULT;
+	std::string error;
+	
+	if (!info.IsConstructCall()) {
+		return Nan::ThrowTypeError("Use new Pru() to create a context");
+	}
+	
+	if (info.Length() > 1) {
+		return Nan::ThrowTypeError("Wrong number of arguments");
+	}
+	
+	if (!parseInitOptions(info.Length() == 1 ? info[0] : Local<Value>(Nan::Undefined()), &options)) {
+		return;
+	}
+	
+	if (info.Length() == 1 && info[0]->IsObject() && !info[0]->IsArray()) {
+		Local<Value> offsetOption = Nan::Get(info[0]->ToObject(), Nan::New("sharedRAMOffset").ToLocalChecked()).ToLocalChecked();
+		if (!offsetOption->IsUndefined()) {
+			if (!offsetOption->IsNumber() || offsetOption->NumberValue() < 0 || offsetOption->NumberValue() * 4 > SHAREDRAM_SIZE) {
+				return Nan::ThrowRangeError("Offset must be within shared RAM (0 to 3072 words)");
+			}
+			offset = offsetOption->Uint32Value();
+		}
+	}
+	
+	if (!openSession(currentEnv(), options, &error)) {
+		return Nan::ThrowError(error.c_str());
+	}
+	
+	Pru* obj = new Pru();
+	obj->sharedRamOffset = offset;
+	obj->open = true;
+	obj->Wrap(info.This());
+	info.GetReturnValue().Set(info.This());
+}
+
+/* Release the driver
+ *	The PRUs keep running. When no other context of the thread, nor init(), holds the
+ *	driver, the thread's interrupt subscriptions, watches and memory views are closed;
+ *	when none in the process does, the driver is.
+ */
+NAN_METHOD(Pru::Close) {
+	Pru* obj = Nan::ObjectWrap::Unwrap<Pru>(info.Holder());
+	
+	if (obj->open) {
+		obj->open = false;
+		closeSession(currentEnv());
+	}
+}
@@ -0,0 +1,74 @@
+#ifndef _CONTEXT_H
+#define _CONTEXT_H
+
+#include <string>
+
+#include <uv.h>
+#include <nan.h>
+
+#include "memory.h"
+#include "session.h"
+
+//Shared RAM offset of init() and of a new context, in words
+#define OFFSET_SHAREDRAM_DEFAULT 2048
+
+/* State of the addon in one thread
+ *	The main thread and every worker that loads the addon get their own: V8 objects
+ *	can't be shared between isolates, and handles belong to the loop of their thread.
+ *	The driver itself is process-wide, see session.h.
+ */
+struct AddonEnv {
+	uv_loop_t* loop;
+	unsigned int sharedRamOffset;	//of the module-level API, in words
+	bool initialised;	//init() holds one of refs
+	unsigned int refs;	//session references of this thread: init() and open contexts
+	Nan::Persistent<v8::Object> mappedViews[NUM_REGIONS];
+	Nan::Persistent<v8::Function> ringConstructor;
+	Nan::Persistent<v8::Function> blockReaderConstructor;
+	Nan::Persistent<v8::Function> planConstructor;
+	Nan::Persistent<v8::FunctionTemplate> pruTemplate;
+};
+
+//Set up the state of the calling thread, first thing in the module initialiser
+AddonEnv* createEnv();
+
+//State of the calling thread
+AddonEnv* currentEnv();
+
+//Take a session reference for the calling thread
+//Returns false and sets error on failure
+bool openSession(AddonEnv* env, const SessionOptions& options, std::string* error);
+
+//Drop a session reference of the calling thread. With its last one, whatever the
+//thread opened is closed: interrupt subscriptions, watches, waits and memory views
+void closeSession(AddonEnv* env);
+
+//Close whatever the calling thread opened, without touching its references
+void releaseThread(AddonEnv* env);
+
+//Parse the argument of init() and new Pru(), defined with init() in prussdrv.cpp
+//Returns false with a pending exception on invalid input
+bool parseInitOptions(v8::Local<v8::Value> value, SessionOptions* options);
+
+/* Independent handle on the PRUSS, new Pru({...})
+ *	Each context holds its own session reference and shared RAM offset, so libraries
+ *	and workers can use the PRUs without agreeing on init(), exit() or the offset.
+ *	Its methods are those of the module, except init(), exit() and the process-wide
+ *	profiler and stats.
+ */
+class Pru : public Nan::ObjectWrap {
+public:
+	static void Init(v8::Local<v8::Object> target);
+	
+	//Shared RAM offset a method works at: the context's when called on one, else the module's
+	static unsigned int* SharedRAMOffset(Nan::NAN_METHOD_ARGS_TYPE info);
+	
+private:
+	static NAN_METHOD(New);
+	static NAN_METHOD(Close);
+	
+	unsigned int sharedRamOffset;
+	bool open;
+};
+
+#endif
@@ -0,0 +1,180 @@
+//System headers
+#include <errno.h>
+#include <string.h>
+
+//PRU Driver headers
+#include <prussdrv.h>
+
+//Node.js addon headers
+#include <nan.h>
+
+#include "memory.h"
+#include "imagecache.h"
+#include "control.h"
+
+using namespace v8;
+
+/* Check the PRU number argument and that the PRUSS is mapped
+ *	Returns false with a pending exception on failure
+ */
+static bool getPru(Nan::NAN_METHOD_ARGS_TYPE info, unsigned int* pru) {
+	if (info.Length() < 1 || !info[0]->IsNumber()) {
+		Nan::ThrowTypeError("PRU number must be Integer");
+		return false;
+	}
+	
+	*pru = info[0]->Uint32Value();
+	if (*pru > 1) {
+		Nan::ThrowRangeError("PRU number must be 0 or 1");
+		return false;
+	}
+	
+	if (memRegions[REGION_DATARAM0].base == NULL) {
+		Nan::ThrowError("PRU memory is not mapped. Did you forget to call init()?");
+		return false;
+	}
+	return true;
+}
+
+/* Halt a PRU after its current instruction
+ *	Its program counter, registers and memory are kept, resume() continues from there.
+ *	Blocks the event loop until the instruction completes: microseconds normally, at most
+ *	10 ms for a PRU stalled on the bus, after which it throws.
+ *
+ *	@param {number} PRU number
+ */
+NAN_METHOD(halt) {
+	Nan::HandleScope scope;
+	unsigned int pru;
+	
+	if (!getPru(info, &pru)) {
+		return;
+	}
+	
+	if (prussdrv_pru_halt(pru) != 0) {
+		return Nan::ThrowError(errno == ETIMEDOUT ? "The PRU did not halt" : strerror(errno));
+	}
+}
+
+/* Let a halted PRU run again
+ *	Without an address it continues where it was halted. With one it is reset and starts
+ *	there, like execute() without reloading its program. Data RAM is untouched either way.
+ *
+ *	@param {number} PRU number
+ *	@param {number} [address] byte address in IRAM to start at
+ */
+NAN_METHOD(resume) {
+	Nan::HandleScope scope;
+	unsigned int pru;
+	
+	if (info.Length() > 2) {
+		return Nan::ThrowTypeError("Wrong number of arguments");
+	}
+	
+	if (!getPru(info, &pru)) {
+		return;
+	}
+	
+	if (info.Length() == 1) {
+		prussdrv_pru_resume(pru);
+		return;
+	}
+	
+	if (!info[1]->IsNumber()) {
+		return Nan::ThrowTypeError("Address must be Integer");
+	}
+	
+	uint32_t address = info[1]->Uint32Value();
+	if (address >= IRAM_SIZE || (address & 3) != 0) {
+		return Nan::ThrowRangeError("Address must be a 4 byte aligned offset in IRAM");
+	}
+	prussdrv_pru_enable_at(pru, address);
+}
+
+/* Execute instructions of a halted PRU one at a time
+ *	Blocks the event loop like halt(), for up to 10 ms per instruction, so keep count small.
+ *
+ *	@param {number} PRU number
+ *	@param {number} [count] instructions, defaults to 1
+ *	@returns {number} program counter afterwards, in bytes
+ */
+NAN_METHOD(step) {
+	Nan::HandleScope scope;
+	unsigned int pru;
+	void* control;
+	
+	if (info.Length() > 2 || (info.Length() == 2 && !info[1]->IsNumber())) {
+		return Nan::ThrowTypeError("Count must be Integer");
+	}
+	
+	if (!getPru(info, &pru)) {
+		return;
+	}
+	
+	uint32_t count = info.Length() == 2 ? info[1]->Uint32Value() : 1;
+	if (prussdrv_pru_step(pru, count) != 0) {
+		return Nan::ThrowError(errno == EBUSY ? "The PRU must be halted to step it" :
+			errno == ETIMEDOUT ? "The PRU did not complete the step" : strerror(errno));
+	}
+	
+	prussdrv_map_pru_control(pru, &control);
+	uint32_t pc = ((volatile uint32_t*) control)[PRU_STATUS_REG / 4] & PRU_STATUS_PCOUNTER_MASK;
+	info.GetReturnValue().Set(Nan::New<Number>(pc * 4));
+}
+
+/* Reset a PRU, leaving it halted at address 0
+ *	Its program and data RAM are kept
+ *
+ *	@param {number} PRU number
+ */
+NAN_METHOD(resetPRU) {
+	Nan::HandleScope scope;
+	unsigned int pru;
+	
+	if (!getPru(info, &pru)) {
+		return;
+	}
+	
+	prussdrv_pru_reset(pru);
+}
+
+/* Get the run state of a PRU
+ *	registers holds r0..r31, which can only be read while the PRU is halted
+ *
+ *	@param {number} PRU number
+ *	@returns {object} { enabled, running, sleeping, pc, cycle, stall, control, [registers] }
+ */
+NAN_METHOD(getState) {
+	Nan::HandleScope scope;
+	unsigned int pru;
+	void* control;
+	void* debug;
+	
+	if (!getPru(info, &pru)) {
+		return;
+	}
+	
+	prussdrv_map_pru_control(pru, &control);
+	prussdrv_map_pru_debug(pru, &debug);
+	volatile uint32_t* regs = (volatile uint32_t*) control;
+	uint32_t value = regs[PRU_CONTROL_REG / 4];
+	
+	Local<Object> state = Nan::New<Object>();
+	Nan::Set(state, Nan::New("enabled").ToLocalChecked(), Nan::New<Boolean>((value & PRU_CONTROL_ENABLE) != 0));
+	Nan::Set(state, Nan::New("running").ToLocalChecked(), Nan::New<Boolean>((value & PRU_CONTROL_RUNSTATE) != 0));
+	Nan::Set(state, Nan::New("sleeping").ToLocalChecked(), Nan::New<Boolean>((value & PRU_CONTROL_SLEEPING) != 0));
+	Nan::Set(state, Nan::New("pc").ToLocalChecked(), Nan::New<Number>((regs[PRU_STATUS_REG / 4] & PRU_STATUS_PCOUNTER_MASK) * 4));
+	Nan::Set(state, Nan::New("cycle").ToLocalChecked(), Nan::New<Number>(regs[PRU_CYCLE_REG / 4]));
+	Nan::Set(state, Nan::New("stall").ToLocalChecked(), Nan::New<Number>(regs[PRU_STALL_REG / 4]));
+	Nan::Set(state, Nan::New("control").ToLocalChecked(), Nan::New<Number>(value));
+	
+	if (!(value & PRU_CONTROL_RUNSTATE)) {
+		Local<Array> registers = Nan::New<Array>(32);
+		for (uint32_t i = 0; i < 32; i++) {
+			Nan::Set(registers, i, Nan::New<Number>(((volatile uint32_t*) debug)[i]));
+		}
+		Nan::Set(state, Nan::New("registers").ToLocalChecked(), registers);
+	}
+	
+	info.GetReturnValue().Set(state);
+}
@@ -0,0 +1,12 @@
+#ifndef _CONTROL_H
+#define _CONTROL_H
+
+#include <nan.h>
+
+NAN_METHOD(halt);
+NAN_METHOD(resume);
+NAN_METHOD(step);
+NAN_METHOD(resetPRU);
+NAN_METHOD(getState);
+
+#endif
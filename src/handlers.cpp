@@ -0,0 +1,404 @@
+//System headers
+#include <dlfcn.h>
+#include <string.h>
+
+//PRU Driver headers
+#include <prussdrv.h>
+#include <pruss_copy.h>
+
+//Node.js addon headers
+#include <node_buffer.h>
+#include <nan.h>
+
+#include "memory.h"
+#include "handlers.h"
+
+using namespace v8;
+
+//Default bound on bytes captured between two JS callbacks
+#define DEFAULT_CAPTURE_LIMIT	(64 * 1024)
+
+//Bounce buffer of copies between two PRU regions
+#define COPY_CHUNK	256
+
+NativeHandler::NativeHandler() : library(NULL), plugin(NULL), notifyEvery(1), sinceNotify(0),
+	flushInterval(0), firstPending(0), captureLimit(DEFAULT_CAPTURE_LIMIT), records(false),
+	snapshot(NULL), snapshotLength(0), dropped(0) {
+	memset(&context, 0, sizeof(context));
+	uv_mutex_init(&lock);
+}
+
+NativeHandler::~NativeHandler() {
+	if (library != NULL) {
+		dlclose(library);
+	}
+	uv_mutex_destroy(&lock);
+}
+
+/* Read an integer property, false with a pending exception if it is missing or not a number */
+static bool getUint(Local<Object> o, const char* name, uint32_t* value) {
+	Local<Value> v = Nan::Get(o, Nan::New(name).ToLocalChecked()).ToLocalChecked();
+	if (!v->IsNumber()) {
+		Nan::ThrowTypeError((std::string(name) + " must be Integer").c_str());
+		return false;
+	}
+	*value = v->Uint32Value();
+	return true;
+}
+
+/* Resolve {region, offset} plus a length to a pointer into mapped PRU memory
+ *	The pointer stays valid until prussdrv_exit(), which only runs after the interrupt
+ *	threads are joined, so it is resolved once here rather than on every interrupt.
+ */
+static bool getAddress(Local<Object> o, const char* regionName, const char* offsetName, uint32_t length, volatile char** address) {
+	uint32_t region, offset;
+	if (!getUint(o, regionName, &region) || !getUint(o, offsetName, &offset)) {
+		return false;
+	}
+	if (!inRegion(region, offset, length)) {
+		Nan::ThrowRangeError("Action out of range of its region, or region not mapped");
+		return false;
+	}
+	*address = memRegions[region].base + offset;
+	return true;
+}
+
+/* Parse one action
+ *	{ op: 'capture', region, offset, length }
+ *	{ op: 'copy', region, offset, length, toRegion, toOffset }
+ *	{ op: 'write', region, offset, data: Buffer }
+ *	{ op: 'clearEvent', event }
+ *	{ op: 'sendEvent', event }
+ */
+static bool parseAction(Local<Value> value, NativeAction* action) {
+	if (!value->IsObject()) {
+		Nan::ThrowTypeError("Actions must be objects");
+		return false;
+	}
+	
+	Local<Object> o = value->ToObject();
+	String::Utf8Value opValue(Nan::Get(o, Nan::New("op").ToLocalChecked()).ToLocalChecked()->ToString());
+	std::string op(*opValue);
+	volatile char* address;
+	
+	action->length = 0;
+	action->event = 0;
+	action->src = NULL;
+	action->dst = NULL;
+	
+	if (op == "capture") {
+		action->op = ACTION_CAPTURE;
+		if (!getUint(o, "length", &action->length) || !getAddress(o, "region", "offset", action->length, &address)) {
+			return false;
+		}
+		action->src = address;
+	} else if (op == "copy") {
+		action->op = ACTION_COPY;
+		if (!getUint(o, "length", &action->length) || !getAddress(o, "region", "offset", action->length, &address)) {
+			return false;
+		}
+		action->src = address;
+		if (!getAddress(o, "toRegion", "toOffset", action->length, &action->dst)) {
+			return false;
+		}
+	} else if (op == "write") {
+		action->op = ACTION_WRITE;
+		Local<Value> data = Nan::Get(o, Nan::New("data").ToLocalChecked()).ToLocalChecked();
+		if (!node::Buffer::HasInstance(data)) {
+			Nan::ThrowTypeError("data must be a Buffer");
+			return false;
+		}
+		action->length = node::Buffer::Length(data);
+		action->data.assign(node::Buffer::Data(data), node::Buffer::Data(data) + action->length);
+		if (!getAddress(o, "region", "offset", action->length, &action->dst)) {
+			return false;
+		}
+	} else if (op == "clearEvent" || op == "sendEvent") {
+		action->op = op == "clearEvent" ? ACTION_CLEAR_EVENT : ACTION_SEND_EVENT;
+		if (!getUint(o, "event", &action->event)) {
+			return false;
+		}
+		if (action->event >= NUM_PRU_SYS_EVTS) {
+			Nan::ThrowRangeError("System event out of range");
+			return false;
+		}
+	} else {
+		Nan::ThrowTypeError("op must be one of capture, copy, write, clearEvent, sendEvent");
+		return false;
+	}
+	return true;
+}
+
+/* Parse batch options into a handler
+ *	{ events: M, interval: N, snapshot: { region, offset, length } }
+ *	Every interrupt appends a record of BATCH_RECORD_HEADER bytes, the UIO count as
+ *	uint32 LE, 4 reserved bytes and uv_hrtime() in ns as uint64 LE, followed by a copy
+ *	of the snapshot window. JS is notified after M events or N microseconds, whichever
+ *	comes first.
+ */
+static bool parseBatch(Local<Value> value, uint32_t* events, uint64_t* interval, const volatile char** snapshot, uint32_t* snapshotLength) {
+	if (!value->IsObject()) {
+		Nan::ThrowTypeError("batch must be an object");
+		return false;
+	}
+	
+	Local<Object> o = value->ToObject();
+	Local<Value> eventsValue = Nan::Get(o, Nan::New("events").ToLocalChecked()).ToLocalChecked();
+	Local<Value> intervalValue = Nan::Get(o, Nan::New("interval").ToLocalChecked()).ToLocalChecked();
+	Local<Value> snapshotValue = Nan::Get(o, Nan::New("snapshot").ToLocalChecked()).ToLocalChecked();
+	
+	*events = 0;
+	*interval = 0;
+	if (!eventsValue->IsUndefined()) {
+		if (!getUint(o, "events", events)) {
+			return false;
+		}
+	}
+	if (!intervalValue->IsUndefined()) {
+		if (!intervalValue->IsNumber() || intervalValue->NumberValue() < 0) {
+			Nan::ThrowTypeError("interval must be a number of microseconds");
+			return false;
+		}
+		*interval = (uint64_t) (intervalValue->NumberValue() * 1000);
+	}
+	if (*events == 0 && *interval == 0) {
+		*events = 1;
+	}
+	
+	*snapshot = NULL;
+	*snapshotLength = 0;
+	if (!snapshotValue->IsUndefined()) {
+		volatile char* address;
+		if (!snapshotValue->IsObject()) {
+			Nan::ThrowTypeError("snapshot must be { region, offset, length }");
+			return false;
+		}
+		Local<Object> window = snapshotValue->ToObject();
+		if (!getUint(window, "length", snapshotLength) || !getAddress(window, "region", "offset", *snapshotLength, &address)) {
+			return false;
+		}
+		*snapshot = address;
+	}
+	return true;
+}
+
+/* Build a handler from onInterrupt() options
+ *	{ actions: [...], plugin: 'libhandler.so', symbol: 'pru_interrupt_handler',
+ *	  notify: 1, captureLimit: 65536, batch: { events, interval, snapshot } }
+ */
+bool NativeHandler::Parse(Local<Object> options, NativeHandler** handler) {
+	Local<Value> batch = Nan::Get(options, Nan::New("batch").ToLocalChecked()).ToLocalChecked();
+	Local<Value> actions = Nan::Get(options, Nan::New("actions").ToLocalChecked()).ToLocalChecked();
+	Local<Value> plugin = Nan::Get(options, Nan::New("plugin").ToLocalChecked()).ToLocalChecked();
+	Local<Value> symbol = Nan::Get(options, Nan::New("symbol").ToLocalChecked()).ToLocalChecked();
+	Local<Value> notify = Nan::Get(options, Nan::New("notify").ToLocalChecked()).ToLocalChecked();
+	Local<Value> captureLimit = Nan::Get(options, Nan::New("captureLimit").ToLocalChecked()).ToLocalChecked();
+	
+	*handler = NULL;
+	if (actions->IsUndefined() && plugin->IsUndefined() && batch->IsUndefined()) {
+		return true;
+	}
+	
+	NativeHandler* h = new NativeHandler();
+	
+	if (!batch->IsUndefined()) {
+		if (!parseBatch(batch, &h->notifyEvery, &h->flushInterval, &h->snapshot, &h->snapshotLength)) {
+			delete h;
+			return false;
+		}
+		h->records = true;
+	}
+	
+	if (!actions->IsUndefined()) {
+		if (!actions->IsArray()) {
+			delete h;
+			Nan::ThrowTypeError("actions must be an array");
+			return false;
+		}
+		Local<Array> a = Local<Array>::Cast(actions);
+		h->actions.resize(a->Length());
+		for (unsigned int i = 0; i < a->Length(); i++) {
+			if (!parseAction(a->Get(i), &h->actions[i])) {
+				delete h;
+				return false;
+			}
+		}
+	}
+	
+	if (!plugin->IsUndefined()) {
+		String::Utf8Value path(plugin->ToString());
+		std::string name = "pru_interrupt_handler";
+		if (!symbol->IsUndefined()) {
+			String::Utf8Value s(symbol->ToString());
+			name = *s;
+		}
+		
+		h->library = dlopen(*path, RTLD_NOW | RTLD_LOCAL);
+		if (h->library == NULL) {
+			std::string error = dlerror();
+			delete h;
+			Nan::ThrowError(error.c_str());
+			return false;
+		}
+		h->plugin = (pru_interrupt_handler_fn) dlsym(h->library, name.c_str());
+		if (h->plugin == NULL) {
+			delete h;
+			Nan::ThrowError((name + " not found in plugin").c_str());
+			return false;
+		}
+	}
+	
+	if (!notify->IsUndefined()) {
+		if (!batch->IsUndefined()) {
+			delete h;
+			Nan::ThrowTypeError("Use batch.events rather than notify with batch");
+			return false;
+		}
+		if (!notify->IsNumber()) {
+			delete h;
+			Nan::ThrowTypeError("notify must be Integer");
+			return false;
+		}
+		h->notifyEvery = notify->Uint32Value();
+	}
+	
+	if (!captureLimit->IsUndefined()) {
+		if (!captureLimit->IsNumber()) {
+			delete h;
+			Nan::ThrowTypeError("captureLimit must be Integer");
+			return false;
+		}
+		h->captureLimit = captureLimit->Uint32Value();
+	}
+	
+	for (unsigned int i = 0; i < PRU_HANDLER_REGIONS && i < NUM_REGIONS; i++) {
+		h->context.region_base[i] = memRegions[i].base;
+		h->context.region_size[i] = memRegions[i].size;
+	}
+	h->context.send_event = (int (*)(unsigned int)) prussdrv_pru_send_event;
+	h->context.clear_event = (int (*)(unsigned int, unsigned int)) prussdrv_pru_clear_event;
+	h->context.capture = CaptureThunk;
+	h->context.internal = h;
+	
+	*handler = h;
+	return true;
+}
+
+bool NativeHandler::Capture(const volatile void* data, size_t length, bool fromDevice) {
+	uv_mutex_lock(&lock);
+	bool fits = captured.size() + length <= captureLimit;
+	if (fits) {
+		size_t at = captured.size();
+		captured.resize(at + length);
+		if (fromDevice) {
+			pruss_copy_from_device(&captured[at], data, length);
+		} else {
+			memcpy(&captured[at], (const void*) data, length);
+		}
+	} else {
+		dropped++;
+	}
+	uv_mutex_unlock(&lock);
+	return fits;
+}
+
+void NativeHandler::CaptureRecord(uint32_t count, uint64_t now) {
+	size_t length = BATCH_RECORD_HEADER + snapshotLength;
+	
+	uv_mutex_lock(&lock);
+	if (captured.size() + length <= captureLimit) {
+		size_t at = captured.size();
+		uint32_t reserved = 0;
+		captured.resize(at + length);
+		memcpy(&captured[at], &count, 4);
+		memcpy(&captured[at + 4], &reserved, 4);
+		memcpy(&captured[at + 8], &now, 8);
+		pruss_copy_from_device(&captured[at + BATCH_RECORD_HEADER], snapshot, snapshotLength);
+	} else {
+		dropped++;
+	}
+	uv_mutex_unlock(&lock);
+}
+
+int NativeHandler::CaptureThunk(struct pru_handler_context* ctx, const void* data, size_t length) {
+	return static_cast<NativeHandler*>(ctx->internal)->Capture(data, length, false);
+}
+
+bool NativeHandler::Run(unsigned int host, uint32_t count, uint64_t now) {
+	bool notify = false;
+	
+	if (records) {
+		CaptureRecord(count, now);
+	}
+	
+	for (size_t i = 0; i < actions.size(); i++) {
+		NativeAction& action = actions[i];
+		switch (action.op) {
+		case ACTION_CAPTURE:
+			Capture(action.src, action.length, true);
+			break;
+		case ACTION_COPY:
+			for (uint32_t done = 0; done < action.length; done += COPY_CHUNK) {
+				char chunk[COPY_CHUNK];
+				uint32_t n = action.length - done < COPY_CHUNK ? action.length - done : COPY_CHUNK;
+				pruss_copy_from_device(chunk, action.src + done, n);
+				pruss_copy_to_device(action.dst + done, chunk, n);
+			}
+			break;
+		case ACTION_WRITE:
+			pruss_copy_to_device(action.dst, action.data.data(), action.length);
+			break;
+		case ACTION_CLEAR_EVENT:
+			prussdrv_pru_clear_event(host, action.event);
+			break;
+		case ACTION_SEND_EVENT:
+			prussdrv_pru_send_event(action.event);
+			break;
+		}
+	}
+	
+	if (plugin != NULL) {
+		context.host = host;
+		context.count = count;
+		notify = plugin(&context) != 0;
+	}
+	
+	if (notifyEvery != 0 && sinceNotify + 1 >= notifyEvery) {
+		notify = true;
+	}
+	if (flushInterval != 0 && sinceNotify != 0 && now - firstPending >= flushInterval) {
+		notify = true;
+	}
+	
+	if (notify) {
+		sinceNotify = 0;
+	} else if (sinceNotify++ == 0) {
+		firstPending = now;
+	}
+	return notify;
+}
+
+int64_t NativeHandler::TimeToFlush(uint64_t now) const {
+	if (flushInterval == 0 || sinceNotify == 0) {
+		return -1;
+	}
+	uint64_t due = firstPending + flushInterval;
+	return due > now ? (int64_t) (due - now) : 0;
+}
+
+bool NativeHandler::Flush(uint64_t now) {
+	if (TimeToFlush(now) != 0) {
+		return false;
+	}
+	sinceNotify = 0;
+	return true;
+}
+
+void NativeHandler::TakeCaptures(std::vector<char>* out, uint32_t* droppedOut) {
+	uv_mutex_lock(&lock);
+	out->swap(captured);
+	captured.clear();
+	*droppedOut = dropped;
+	dropped = 0;
+	uv_mutex_unlock(&lock);
+}
@@ -0,0 +1,83 @@
+#ifndef _HANDLERS_H
+#define _HANDLERS_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <uv.h>
+#include <nan.h>
+
+#include "pru_handler.h"
+
+//Built-in actions
+#define ACTION_CAPTURE		1	//append PRU memory to the data passed to JS
+#define ACTION_COPY			2	//copy between PRU memory regions
+#define ACTION_WRITE		3	//write constant bytes to PRU memory
+#define ACTION_CLEAR_EVENT	4	//clear a system event and re-enable the host interrupt
+#define ACTION_SEND_EVENT	5	//raise a system event
+
+//Bytes before the snapshot in each batch record: count (uint32), reserved, time in ns (uint64)
+#define BATCH_RECORD_HEADER	16
+
+struct NativeAction {
+	int op;
+	volatile char* dst;
+	const volatile char* src;
+	uint32_t length;
+	unsigned int event;
+	std::vector<char> data;
+};
+
+/* Work done on the interrupt thread for every interrupt, without entering JS
+ *	A list of built-in actions runs first, then an optional dlopen'd plugin.
+ *	Captured bytes are handed to JS in batches.
+ */
+class NativeHandler {
+public:
+	//Build from onInterrupt() options, handler is NULL when they ask for none
+	//Returns false with a pending exception on invalid input
+	static bool Parse(v8::Local<v8::Object> options, NativeHandler** handler);
+	
+	~NativeHandler();
+	
+	//Interrupt thread: handle one interrupt at time now (ns), returns true when JS should be notified
+	bool Run(unsigned int host, uint32_t count, uint64_t now);
+	
+	//Interrupt thread: ns until a pending batch is due, or -1 when nothing is pending
+	int64_t TimeToFlush(uint64_t now) const;
+	
+	//Interrupt thread: notify JS of a batch that is due, returns true if one was
+	bool Flush(uint64_t now);
+	
+	//Loop thread: take the bytes captured since the last call
+	void TakeCaptures(std::vector<char>* out, uint32_t* dropped);
+	
+private:
+	NativeHandler();
+	
+	bool Capture(const volatile void* data, size_t length, bool fromDevice);
+	void CaptureRecord(uint32_t count, uint64_t now);
+	static int CaptureThunk(struct pru_handler_context* ctx, const void* data, size_t length);
+	
+	std::vector<NativeAction> actions;
+	void* library;
+	pru_interrupt_handler_fn plugin;
+	struct pru_handler_context context;
+	uint32_t notifyEvery;
+	uint32_t sinceNotify;
+	uint64_t flushInterval;		//ns, 0 to only notify by count
+	uint64_t firstPending;		//time of the oldest interrupt JS has not heard of
+	size_t captureLimit;
+	
+	//Batch records, see Parse
+	bool records;
+	const volatile char* snapshot;
+	uint32_t snapshotLength;
+	
+	uv_mutex_t lock;
+	std::vector<char> captured;
+	uint32_t dropped;
+};
+
+#endif
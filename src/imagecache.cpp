@@ -0,0 +1,242 @@
+//System headers
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <map>
+#include <algorithm>
+
+//PRU Driver headers
+#include <prussdrv.h>
+#include <pruss_copy.h>
+
+#include <uv.h>
+
+#include "memory.h"
+#include "imagecache.h"
+
+//Files kept in the cache, least recently used ones are dropped beyond this
+#define MAX_CACHED_IMAGES	16
+
+struct CachedFile {
+	dev_t dev;
+	ino_t ino;
+	off_t size;
+	struct timespec mtime;
+	uint64_t lastUse;
+	FirmwareImage image;
+};
+
+static std::map<std::string, CachedFile> cachedFiles;
+static uint64_t cacheClock;
+static uv_mutex_t cacheMutex;
+static uv_once_t cacheOnce = UV_ONCE_INIT;
+
+//Image currently in each PRU's IRAM, an empty words pointer if unknown, under cacheMutex
+//as well since workers may start firmware concurrently
+static FirmwareImage residentCode[2];
+
+static void initCacheMutex() {
+	uv_mutex_init(&cacheMutex);
+}
+
+/* 64 bit FNV-1a */
+static uint64_t hashBytes(const void* data, size_t length) {
+	const unsigned char* p = (const unsigned char*) data;
+	uint64_t hash = 14695981039346656037ULL;
+	for (size_t i = 0; i < length; i++) {
+		hash = (hash ^ p[i]) * 1099511628211ULL;
+	}
+	return hash;
+}
+
+void loadImageData(const void* data, size_t length, FirmwareImage* image) {
+	std::vector<uint32_t>* words = new std::vector<uint32_t>((length + 3) / 4, 0);
+	memcpy(&(*words)[0], data, length);
+	image->words.reset(words);
+	image->length = length;
+	image->hash = hashBytes(data, length);
+}
+
+static bool sameFile(const CachedFile& file, const struct stat& st) {
+	return file.dev == st.st_dev && file.ino == st.st_ino && file.size == st.st_size &&
+		file.mtime.tv_sec == st.st_mtim.tv_sec && file.mtime.tv_nsec == st.st_mtim.tv_nsec;
+}
+
+static void evictOldest() {
+	std::map<std::string, CachedFile>::iterator oldest = cachedFiles.begin();
+	for (std::map<std::string, CachedFile>::iterator it = cachedFiles.begin(); it != cachedFiles.end(); ++it) {
+		if (it->second.lastUse < oldest->second.lastUse) {
+			oldest = it;
+		}
+	}
+	cachedFiles.erase(oldest);
+}
+
+bool loadImageFile(const std::string& path, size_t maxSize, FirmwareImage* image, std::string* error) {
+	uv_once(&cacheOnce, initCacheMutex);
+	
+	int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		*error = path + ": " + strerror(errno);
+		return false;
+	}
+	
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		*error = path + ": " + strerror(errno);
+		close(fd);
+		return false;
+	}
+	
+	if (st.st_size == 0 || (size_t) st.st_size > maxSize) {
+		*error = path + ": image must be between 1 and " + std::to_string(maxSize) + " bytes";
+		close(fd);
+		return false;
+	}
+	
+	uv_mutex_lock(&cacheMutex);
+	std::map<std::string, CachedFile>::iterator it = cachedFiles.find(path);
+	if (it != cachedFiles.end() && sameFile(it->second, st)) {
+		it->second.lastUse = ++cacheClock;
+		*image = it->second.image;
+		uv_mutex_unlock(&cacheMutex);
+		close(fd);
+		return true;
+	}
+	uv_mutex_unlock(&cacheMutex);
+	
+	std::vector<unsigned char> data(st.st_size);
+	size_t done = 0;
+	while (done < data.size()) {
+		ssize_t n = read(fd, &data[done], data.size() - done);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			*error = path + ": " + (n < 0 ? strerror(errno) : "file shrank while reading");
+			close(fd);
+			return false;
+		}
+		done += n;
+	}
+	close(fd);
+	
+	loadImageData(&data[0], data.size(), image);
+	
+	uv_mutex_lock(&cacheMutex);
+	if (cachedFiles.find(path) == cachedFiles.end() && cachedFiles.size() >= MAX_CACHED_IMAGES) {
+		evictOldest();
+	}
+	CachedFile& file = cachedFiles[path];
+	file.dev = st.st_dev;
+	file.ino = st.st_ino;
+	file.size = st.st_size;
+	file.mtime = st.st_mtim;
+	file.lastUse = ++cacheClock;
+	file.image = *image;
+	uv_mutex_unlock(&cacheMutex);
+	return true;
+}
+
+/* Write the words of image that differ from old, as runs of consecutive words
+ *	Words past the end of old are always written.
+ */
+static void writeChangedWords(unsigned int ramId, const std::vector<uint32_t>& image, const std::vector<uint32_t>* old) {
+	size_t common = old ? std::min(old->size(), image.size()) : 0;
+	size_t i = 0;
+	
+	while (i < image.size()) {
+		if (i < common && (*old)[i] == image[i]) {
+			i++;
+			continue;
+		}
+		
+		size_t start = i;
+		while (i < image.size() && !(i < common && (*old)[i] == image[i])) {
+			i++;
+		}
+		prussdrv_pru_write_memory(ramId, start, (const unsigned int*) &image[start], (i - start) * 4);
+	}
+}
+
+/* Check that IRAM still holds the resident image
+ *	Only done when asked for: the record is already forgotten whenever a session opens or
+ *	closes, so it can only be stale if something outside the driver, the kernel remoteproc
+ *	or another process, wrote IRAM meanwhile. A diff against such contents would leave
+ *	their words behind, and one burst read is still cheaper than rewriting the image.
+ */
+static bool residentIntact(unsigned int ramId, const std::vector<uint32_t>& resident) {
+	void* iram;
+	if (prussdrv_map_prumem(ramId, &iram) != 0 || iram == NULL) {
+		return false;
+	}
+	
+	std::vector<uint32_t> actual(resident.size());
+	pruss_copy_from_device(&actual[0], iram, actual.size() * 4);
+	return actual == resident;
+}
+
+int executeImage(int pruNum, const FirmwareImage& image, size_t address, bool verify) {
+	if (pruNum != 0 && pruNum != 1) {
+		return -1;
+	}
+	
+	uv_once(&cacheOnce, initCacheMutex);
+	uv_mutex_lock(&cacheMutex);
+	FirmwareImage& resident = residentCode[pruNum];
+	unsigned int ramId = pruNum == 0 ? PRUSS0_PRU0_IRAM : PRUSS0_PRU1_IRAM;
+	
+	//IRAM can only be accessed while the PRU is disabled, which also resets it
+	prussdrv_pru_disable(pruNum);
+	
+	if (verify && resident.words && !residentIntact(ramId, *resident.words)) {
+		resident = FirmwareImage();
+	}
+	const std::vector<uint32_t>* old = resident.words.get();
+	
+	if (old != image.words.get() && !(old && resident.hash == image.hash && *old == *image.words)) {
+		writeChangedWords(ramId, *image.words, old);
+		
+		//IRAM beyond a shorter image keeps the old words, which a later diff must still see
+		if (old && old->size() > image.words->size()) {
+			std::vector<uint32_t>* merged = new std::vector<uint32_t>(*old);
+			std::copy(image.words->begin(), image.words->end(), merged->begin());
+			resident.words.reset(merged);
+			resident.length = old->size() * 4;
+			resident.hash = hashBytes(&(*merged)[0], merged->size() * 4);
+		} else {
+			resident = image;
+		}
+	}
+	
+	prussdrv_pru_enable_at(pruNum, address);
+	uv_mutex_unlock(&cacheMutex);
+	return 0;
+}
+
+int loadDataImage(int pruNum, const FirmwareImage& image) {
+	if ((pruNum != 0 && pruNum != 1) || image.length > DATARAM_SIZE) {
+		return -1;
+	}
+	
+	volatile uint32_t* ram = (volatile uint32_t*) memRegions[pruNum == 0 ? REGION_DATARAM0 : REGION_DATARAM1].base;
+	if (ram == NULL) {
+		return -1;
+	}
+	
+	//Data RAM is written by JS and by the firmware, so there is nothing to diff against.
+	//Comparing first would cost a non-posted read per word, more than the write it saves.
+	prussdrv_pru_disable(pruNum);
+	pruss_copy_to_device(ram, &(*image.words)[0], image.words->size() * 4);
+	return 0;
+}
+
+void forgetResidentImages() {
+	uv_once(&cacheOnce, initCacheMutex);
+	uv_mutex_lock(&cacheMutex);
+	residentCode[0] = FirmwareImage();
+	residentCode[1] = FirmwareImage();
+	uv_mutex_unlock(&cacheMutex);
+}
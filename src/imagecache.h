@@ -0,0 +1,42 @@
+#ifndef _IMAGECACHE_H
+#define _IMAGECACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <memory>
+
+//Size of each PRU's instruction RAM in bytes
+#define IRAM_SIZE	8192
+
+/* A firmware or data image, padded with zeros to whole words
+ *	The words are shared between the file cache, pending loads and the
+ *	record of what is resident, and are never modified once built.
+ */
+struct FirmwareImage {
+	std::shared_ptr<const std::vector<uint32_t> > words;
+	size_t length;		//bytes, before padding
+	uint64_t hash;
+};
+
+//Get the image of a file, from the cache when its path, inode, size and mtime are unchanged
+//Safe to call from the threadpool. Returns false and sets error on failure
+bool loadImageFile(const std::string& path, size_t maxSize, FirmwareImage* image, std::string* error);
+
+//Build an image from memory, e.g. a Buffer
+void loadImageData(const void* data, size_t length, FirmwareImage* image);
+
+//Load an image into IRAM and start the PRU at address, writing only words that differ
+//from the image already resident. With verify, IRAM is first read back to check it still
+//holds that image. Any loop thread, returns 0 on success
+int executeImage(int pruNum, const FirmwareImage& image, size_t address, bool verify);
+
+//Load an image into data RAM with the PRU disabled, in one burst copy
+//Loop thread only, returns 0 on success
+int loadDataImage(int pruNum, const FirmwareImage& image);
+
+//Forget what is resident, when IRAM may have been changed behind our back
+void forgetResidentImages();
+
+#endif
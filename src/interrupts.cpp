@@ -0,0 +1,605 @@
+//System headers
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+
+//PRU Driver headers
+#include <prussdrv.h>
+
+//Node.js addon headers
+#include <uv.h>
+#include <nan.h>
+
+#include "interrupts.h"
+#include "stats.h"
+#include "handlers.h"
+
+using namespace v8;
+
+/* Persistent subscription to one host interrupt
+ *	By default the UIO fd is polled on the event loop thread, so no threadpool thread is
+ *	parked in a blocking read() and nothing has to be re-armed per interrupt.
+ *	Optionally a dedicated thread, which can run SCHED_FIFO on a chosen CPU, blocks on the
+ *	fd instead and hands the count over through a uv_async_t. Interrupts arriving before
+ *	the loop gets to it are coalesced into one callback.
+ *	The count is read through the driver, which also knows the eventfds of the simulator.
+ */
+struct InterruptWatcher {
+	uv_poll_t handle;
+	uv_async_t async;
+	bool threaded;
+	int fd;
+	unsigned int host;
+	int autoClear;		//system event cleared as soon as the interrupt is read, or -1
+	uint32_t lastCount;
+	bool primed;
+	Nan::Callback callback;
+	Nan::AsyncResource resource;
+	
+	//Dedicated thread only, pending* are shared with it under lock
+	NativeHandler* handler;
+	pthread_t thread;
+	int stopFd;
+	uv_mutex_t lock;
+	bool pending;
+	uint32_t pendingCount;
+	uint32_t pendingReads;	//events read since the last delivery, coalesced or handled natively
+	uint64_t pendingWake;
+	int pendingError;
+	
+	InterruptWatcher() : resource("pru:InterruptWatcher") {}
+};
+
+/* Scheduling of a dedicated interrupt thread */
+struct ThreadOptions {
+	int priority;		//SCHED_FIFO priority, 0 to keep SCHED_OTHER
+	cpu_set_t cpus;
+	bool pinned;
+	bool lockMemory;
+};
+
+//Subscriptions of all threads, under watchersLock. Each belongs to the loop it was made on.
+static InterruptWatcher* watchers[NUM_PRU_HOSTIRQS];
+static uv_mutex_t watchersLock;
+static uv_once_t watchersOnce = UV_ONCE_INIT;
+
+static void initWatchersLock() {
+	uv_mutex_init(&watchersLock);
+}
+
+static uv_loop_t* watcherLoop(InterruptWatcher* watcher) {
+	return watcher->threaded ? watcher->async.loop : watcher->handle.loop;
+}
+
+static void onWatcherClosed(uv_handle_t* handle) {
+	InterruptWatcher* watcher = static_cast<InterruptWatcher*>(handle->data);
+	if (watcher->threaded) {
+		uv_mutex_destroy(&watcher->lock);
+	}
+	delete watcher->handler;
+	delete watcher;
+}
+
+static void closeWatcher(InterruptWatcher* watcher) {
+	if (watcher->threaded) {
+		//The thread sleeps in poll() on the stop eventfd as well, so this returns promptly
+		uint64_t one = 1;
+		if (write(watcher->stopFd, &one, sizeof(one)) == sizeof(one)) {
+			pthread_join(watcher->thread, NULL);
+		}
+		close(watcher->stopFd);
+		uv_close((uv_handle_t*) &watcher->async, onWatcherClosed);
+	} else {
+		uv_poll_stop(&watcher->handle);
+		uv_close((uv_handle_t*) &watcher->handle, onWatcherClosed);
+	}
+}
+
+/* Cancel the subscription of a host, if it was made on loop
+ *	Returns false, leaving it alone, if another thread's subscription is in the way
+ */
+static bool stopWatcher(unsigned int host, uv_loop_t* loop) {
+	uv_once(&watchersOnce, initWatchersLock);
+	uv_mutex_lock(&watchersLock);
+	InterruptWatcher* watcher = watchers[host];
+	if (watcher != NULL && watcherLoop(watcher) != loop) {
+		uv_mutex_unlock(&watchersLock);
+		return false;
+	}
+	watchers[host] = NULL;
+	uv_mutex_unlock(&watchersLock);
+	
+	if (watcher != NULL) {
+		closeWatcher(watcher);
+	}
+	return true;
+}
+
+/* Publish a new subscription, unless another thread got the host in the meantime */
+static bool addWatcher(InterruptWatcher* watcher) {
+	uv_mutex_lock(&watchersLock);
+	if (watchers[watcher->host] != NULL) {
+		uv_mutex_unlock(&watchersLock);
+		closeWatcher(watcher);
+		return false;
+	}
+	watchers[watcher->host] = watcher;
+	uv_mutex_unlock(&watchersLock);
+	return true;
+}
+
+/* Hand a UIO event count to JS
+ *	The counter is cumulative, what it advanced by since the last delivery beyond the
+ *	reads that saw it is reported as missed events. Reads coalesced into this callback or
+ *	handled natively were seen, so they don't count.
+ */
+static void deliver(InterruptWatcher* watcher, uint32_t count, uint32_t reads, uint64_t wake) {
+	if (reads > 0) {
+		statsInterrupt(watcher->host, count, reads, wake);
+	}
+	
+	uint32_t gap = count - watcher->lastCount;
+	uint32_t missed = watcher->primed && gap > reads ? gap - reads : 0;
+	watcher->lastCount = count;
+	watcher->primed = true;
+	
+	Local<Value> argv[] = {
+		Nan::Null(),
+		Nan::New<Number>(count),
+		Nan::New<Number>(missed),
+		Nan::Undefined(),
+		Nan::Undefined()
+	};
+	int argc = 3;
+	
+	//Batch of what the native handler captured since the last callback
+	if (watcher->handler != NULL) {
+		std::vector<char> captured;
+		uint32_t dropped;
+		watcher->handler->TakeCaptures(&captured, &dropped);
+		argv[3] = Nan::CopyBuffer(captured.data(), captured.size()).ToLocalChecked();
+		argv[4] = Nan::New<Number>(dropped);
+		argc = 5;
+	}
+	
+	uint64_t dispatched = statsNow();
+	statsRecord(STAGE_DISPATCH, wake, dispatched);
+	watcher->callback.Call(argc, argv, &watcher->resource);
+	statsRecord(STAGE_CALLBACK, dispatched, statsNow());
+}
+
+static void deliverError(InterruptWatcher* watcher, const char* message) {
+	Local<Value> argv[] = { Nan::Error(message) };
+	stopWatcher(watcher->host, watcherLoop(watcher));
+	watcher->callback.Call(1, argv, &watcher->resource);
+}
+
+static void onWatcherReadable(uv_poll_t* handle, int status, int events) {
+	Nan::HandleScope scope;
+	InterruptWatcher* watcher = static_cast<InterruptWatcher*>(handle->data);
+	unsigned int count;
+	
+	if (status < 0) {
+		return deliverError(watcher, uv_strerror(status));
+	}
+	
+	if (prussdrv_pru_read_event(watcher->host, &count) != 0) {
+		//Spurious wake-up, the next readable event will catch up
+		return;
+	}
+	
+	if (watcher->autoClear >= 0) {
+		prussdrv_pru_clear_event(watcher->host, watcher->autoClear);
+	}
+	
+	deliver(watcher, count, 1, statsNow());
+}
+
+/* Body of a dedicated interrupt thread
+ *	Only blocks, reads and signals, it never touches V8.
+ */
+static void* interruptThread(void* arg) {
+	InterruptWatcher* watcher = static_cast<InterruptWatcher*>(arg);
+	struct pollfd fds[2];
+	unsigned int lastCount = 0;
+	uint32_t reads = 0;
+	
+	fds[0].fd = watcher->fd;
+	fds[0].events = POLLIN;
+	fds[1].fd = watcher->stopFd;
+	fds[1].events = POLLIN;
+	
+	for (;;) {
+		int error = 0;
+		unsigned int count = lastCount;
+		struct timespec timeout;
+		struct timespec* wait = NULL;
+		
+		//Wake up in time to deliver a batch that is due, even if no more interrupts come
+		int64_t flushIn = watcher->handler ? watcher->handler->TimeToFlush(uv_hrtime()) : -1;
+		if (flushIn >= 0) {
+			timeout.tv_sec = flushIn / 1000000000;
+			timeout.tv_nsec = flushIn % 1000000000;
+			wait = &timeout;
+		}
+		
+		int n = ppoll(fds, 2, wait, NULL);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			error = errno;
+		} else if (n == 0) {
+			if (!watcher->handler->Flush(uv_hrtime())) {
+				continue;
+			}
+		} else if (fds[1].revents) {
+			break;
+		} else if (fds[0].revents & (POLLERR | POLLHUP | POLLNVAL)) {
+			error = EIO;
+		} else if (prussdrv_pru_read_event(watcher->host, &count) != 0) {
+			continue;
+		} else {
+			lastCount = count;
+			reads++;
+			if (watcher->autoClear >= 0) {
+				prussdrv_pru_clear_event(watcher->host, watcher->autoClear);
+			}
+			if (watcher->handler != NULL && !watcher->handler->Run(watcher->host, count, uv_hrtime())) {
+				//Handled natively, JS hears about it with a later batch
+				continue;
+			}
+		}
+		
+		uint64_t wake = statsNow();
+		uv_mutex_lock(&watcher->lock);
+		if (error) {
+			watcher->pendingError = error;
+		} else {
+			//Keep the first wake-up of a coalesced batch, so stats show the full delay
+			if (!watcher->pending) {
+				watcher->pendingWake = wake;
+			}
+			watcher->pending = true;
+			watcher->pendingCount = count;
+			watcher->pendingReads += reads;
+			reads = 0;
+		}
+		uv_mutex_unlock(&watcher->lock);
+		uv_async_send(&watcher->async);
+		
+		if (error) {
+			break;
+		}
+	}
+	return NULL;
+}
+
+static void onWatcherAsync(uv_async_t* handle) {
+	Nan::HandleScope scope;
+	InterruptWatcher* watcher = static_cast<InterruptWatcher*>(handle->data);
+	
+	uv_mutex_lock(&watcher->lock);
+	bool pending = watcher->pending;
+	uint32_t count = watcher->pendingCount;
+	uint32_t reads = watcher->pendingReads;
+	uint64_t wake = watcher->pendingWake;
+	int error = watcher->pendingError;
+	watcher->pending = false;
+	watcher->pendingReads = 0;
+	uv_mutex_unlock(&watcher->lock);
+	
+	if (pending) {
+		deliver(watcher, count, reads, wake);
+	}
+	
+	//The callback may have unsubscribed
+	uv_mutex_lock(&watchersLock);
+	bool subscribed = watchers[watcher->host] == watcher;
+	uv_mutex_unlock(&watchersLock);
+	if (error && subscribed) {
+		deliverError(watcher, strerror(error));
+	}
+}
+
+/* Parse the options of a dedicated interrupt thread
+ *	{ thread: true, priority: 80, cpu: 1 | [0, 1], mlock: true }, any of them implies thread.
+ *	Returns false with a pending exception on invalid input
+ */
+static bool parseThreadOptions(Local<Object> options, bool* threaded, ThreadOptions* thread) {
+	Local<Value> threadOption = Nan::Get(options, Nan::New("thread").ToLocalChecked()).ToLocalChecked();
+	Local<Value> priority = Nan::Get(options, Nan::New("priority").ToLocalChecked()).ToLocalChecked();
+	Local<Value> cpu = Nan::Get(options, Nan::New("cpu").ToLocalChecked()).ToLocalChecked();
+	Local<Value> mlock = Nan::Get(options, Nan::New("mlock").ToLocalChecked()).ToLocalChecked();
+	
+	*threaded = threadOption->BooleanValue() || !priority->IsUndefined() || !cpu->IsUndefined() || mlock->BooleanValue();
+	
+	thread->priority = 0;
+	if (!priority->IsUndefined()) {
+		int min = sched_get_priority_min(SCHED_FIFO);
+		int max = sched_get_priority_max(SCHED_FIFO);
+		if (!priority->IsNumber() || priority->Int32Value() < 0 || priority->Int32Value() > max) {
+			Nan::ThrowRangeError("priority must be 0 or a SCHED_FIFO priority");
+			return false;
+		}
+		thread->priority = priority->Int32Value();
+		if (thread->priority != 0 && thread->priority < min) {
+			thread->priority = min;
+		}
+	}
+	
+	CPU_ZERO(&thread->cpus);
+	thread->pinned = !cpu->IsUndefined();
+	if (thread->pinned) {
+		Local<Array> list;
+		if (cpu->IsArray()) {
+			list = Local<Array>::Cast(cpu);
+		} else {
+			list = Nan::New<Array>(1);
+			Nan::Set(list, 0, cpu);
+		}
+		
+		for (unsigned int i = 0; i < list->Length(); i++) {
+			Local<Value> n = list->Get(i);
+			if (!n->IsNumber() || n->Uint32Value() >= CPU_SETSIZE) {
+				Nan::ThrowRangeError("cpu must be a CPU number or an array of them");
+				return false;
+			}
+			CPU_SET(n->Uint32Value(), &thread->cpus);
+		}
+	}
+	
+	thread->lockMemory = mlock->BooleanValue();
+	return true;
+}
+
+/* Start the dedicated thread of a watcher
+ *	Scheduling is set through the thread attributes, so a lack of privileges fails here,
+ *	synchronously, rather than leaving a thread running with the wrong policy.
+ *	Returns an errno value
+ */
+static int startThread(InterruptWatcher* watcher, const ThreadOptions& options) {
+	static bool memoryLocked = false;
+	pthread_attr_t attr;
+	int rc;
+	
+	if (options.lockMemory && !memoryLocked) {
+		if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+			return errno;
+		}
+		memoryLocked = true;
+	}
+	
+	pthread_attr_init(&attr);
+	if (options.priority > 0) {
+		struct sched_param param;
+		memset(&param, 0, sizeof(param));
+		param.sched_priority = options.priority;
+		pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+		pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+		pthread_attr_setschedparam(&attr, &param);
+	}
+	if (options.pinned) {
+		pthread_attr_setaffinity_np(&attr, sizeof(options.cpus), &options.cpus);
+	}
+	
+	rc = pthread_create(&watcher->thread, &attr, interruptThread, watcher);
+	pthread_attr_destroy(&attr);
+	return rc;
+}
+
+/* Subscribe to a host interrupt
+ *	The callback runs on the event loop for every interrupt until offInterrupt() is called.
+ *	It still has to clear the system event with clearInterrupt(), unless autoClear names
+ *	the event, which is then cleared natively as soon as the interrupt is read.
+ *	With ref: false the subscription alone does not keep the process running.
+ *	With options, a dedicated thread waits for the interrupt, see parseThreadOptions.
+ *	Its callbacks may then cover several interrupts; missed only counts those no read saw.
+ *	The thread can also handle every interrupt natively, with built-in actions or a
+ *	plugin, see NativeHandler::Parse. JS then gets the captured bytes in batches.
+ *	With batch, each interrupt adds a timestamped record and callbacks come every
+ *	batch.events interrupts or batch.interval microseconds.
+ *
+ *	@param {number} host interrupt (PRU_EVTOUT_0..7)
+ *	@param {object} [options] { autoClear, ref, thread, priority, cpu, mlock, actions, plugin, symbol, notify, captureLimit, batch }
+ *	@param {function} callback(err, count, missed, [captured, dropped])
+ */
+NAN_METHOD(onInterrupt) {
+	Nan::HandleScope scope;
+	bool threaded = false;
+	ThreadOptions threadOptions;
+	NativeHandler* handler = NULL;
+	int autoClear = -1;
+	bool ref = true;
+	
+	if (info.Length() != 2 && info.Length() != 3) {
+		return Nan::ThrowTypeError("Wrong number of arguments");
+	}
+	
+	if (!info[0]->IsNumber() || !info[info.Length() - 1]->IsFunction()) {
+		return Nan::ThrowTypeError("Arguments must be a host interrupt number and a function");
+	}
+	
+	if (info.Length() == 3) {
+		if (!info[1]->IsObject()) {
+			return Nan::ThrowTypeError("Options must be an object");
+		}
+		if (!parseThreadOptions(info[1]->ToObject(), &threaded, &threadOptions)) {
+			return;
+		}
+		
+		Local<Value> refOption = Nan::Get(info[1]->ToObject(), Nan::New("ref").ToLocalChecked()).ToLocalChecked();
+		ref = refOption->IsUndefined() || refOption->BooleanValue();
+		
+		Local<Value> autoClearOption = Nan::Get(info[1]->ToObject(), Nan::New("autoClear").ToLocalChecked()).ToLocalChecked();
+		if (!autoClearOption->IsUndefined()) {
+			if (!autoClearOption->IsNumber() || autoClearOption->Uint32Value() >= NUM_PRU_SYS_EVTS) {
+				return Nan::ThrowRangeError("autoClear must be a system event");
+			}
+			autoClear = autoClearOption->Uint32Value();
+		}
+	}
+	
+	unsigned int host = info[0]->Uint32Value();
+	if (host >= NUM_PRU_HOSTIRQS) {
+		return Nan::ThrowRangeError("Host interrupt out of range");
+	}
+	
+	int fd = prussdrv_pru_event_fd(host);
+	if (fd <= 0) {
+		return Nan::ThrowError("Host interrupt is not open");
+	}
+	
+	//Native handlers run on the dedicated thread only
+	if (info.Length() == 3) {
+		if (!NativeHandler::Parse(info[1]->ToObject(), &handler)) {
+			return;
+		}
+		threaded = threaded || handler != NULL;
+	}
+	
+	//Replace an existing subscription rather than waiting on the fd twice
+	uv_loop_t* loop = Nan::GetCurrentEventLoop();
+	if (!stopWatcher(host, loop)) {
+		delete handler;
+		return Nan::ThrowError("Host interrupt is subscribed to by another thread");
+	}
+	
+	InterruptWatcher* watcher = new InterruptWatcher();
+	watcher->threaded = threaded;
+	watcher->handler = handler;
+	watcher->autoClear = autoClear;
+	watcher->fd = fd;
+	watcher->host = host;
+	watcher->lastCount = 0;
+	watcher->primed = false;
+	watcher->callback.Reset(info[info.Length() - 1].As<Function>());
+	watcher->handle.data = watcher;
+	watcher->async.data = watcher;
+	
+	if (!threaded) {
+		int rc = uv_poll_init(loop, &watcher->handle, fd);
+		if (rc != 0) {
+			delete watcher;
+			return Nan::ThrowError(uv_strerror(rc));
+		}
+		
+		uv_poll_start(&watcher->handle, UV_READABLE, onWatcherReadable);
+		if (!ref) {
+			uv_unref((uv_handle_t*) &watcher->handle);
+		}
+		if (!addWatcher(watcher)) {
+			return Nan::ThrowError("Host interrupt is subscribed to by another thread");
+		}
+		return;
+	}
+	
+	watcher->pending = false;
+	watcher->pendingReads = 0;
+	watcher->pendingError = 0;
+	watcher->stopFd = eventfd(0, EFD_CLOEXEC);
+	if (watcher->stopFd < 0) {
+		int error = errno;
+		delete handler;
+		delete watcher;
+		return Nan::ThrowError(strerror(error));
+	}
+	uv_mutex_init(&watcher->lock);
+	uv_async_init(loop, &watcher->async, onWatcherAsync);
+	if (!ref) {
+		uv_unref((uv_handle_t*) &watcher->async);
+	}
+	
+	int rc = startThread(watcher, threadOptions);
+	if (rc != 0) {
+		close(watcher->stopFd);
+		uv_close((uv_handle_t*) &watcher->async, onWatcherClosed);
+		return Nan::ThrowError(rc == EPERM ?
+			"Not permitted to use SCHED_FIFO or mlockall, run as root or grant CAP_SYS_NICE and CAP_IPC_LOCK" :
+			strerror(rc));
+	}
+	
+	if (!addWatcher(watcher)) {
+		return Nan::ThrowError("Host interrupt is subscribed to by another thread");
+	}
+}
+
+/* Cancel a host interrupt subscription
+ *
+ *	@param {number} host interrupt
+ */
+NAN_METHOD(offInterrupt) {
+	Nan::HandleScope scope;
+	
+	if (info.Length() != 1) {
+		return Nan::ThrowTypeError("Wrong number of arguments");
+	}
+	
+	if (!info[0]->IsNumber()) {
+		return Nan::ThrowTypeError("Argument must be Integer");
+	}
+	
+	unsigned int host = info[0]->Uint32Value();
+	if (host >= NUM_PRU_HOSTIRQS) {
+		return Nan::ThrowRangeError("Host interrupt out of range");
+	}
+	
+	if (!stopWatcher(host, Nan::GetCurrentEventLoop())) {
+		return Nan::ThrowError("Host interrupt is subscribed to by another thread");
+	}
+}
+
+/* Feed a host interrupt from a file descriptor instead of /dev/uioN
+ *	Meant for tests: each read() of fd must return the 4 byte running event count, as
+ *	UIO does, e.g. a FIFO the test writes counts to. fd is duplicated, the caller keeps
+ *	its own. Works on the hardware and on the simulator, until the driver is closed.
+ *
+ *	@param {number} host interrupt
+ *	@param {number} fd
+ */
+NAN_METHOD(attachEventFd) {
+	if (info.Length() != 2) {
+		return Nan::ThrowTypeError("Wrong number of arguments");
+	}
+	
+	if (!info[0]->IsNumber() || !info[1]->IsNumber()) {
+		return Nan::ThrowTypeError("Arguments must be Integer");
+	}
+	
+	unsigned int host = info[0]->Uint32Value();
+	if (host >= NUM_PRU_HOSTIRQS) {
+		return Nan::ThrowRangeError("Host interrupt out of range");
+	}
+	
+	//A subscription would keep polling the fd being replaced
+	uv_once(&watchersOnce, initWatchersLock);
+	uv_mutex_lock(&watchersLock);
+	bool subscribed = watchers[host] != NULL;
+	uv_mutex_unlock(&watchersLock);
+	if (subscribed) {
+		return Nan::ThrowError("Host interrupt is subscribed to, call offInterrupt() first");
+	}
+	
+	int fd = fcntl(info[1]->Int32Value(), F_DUPFD_CLOEXEC, 0);
+	if (fd < 0) {
+		return Nan::ThrowError(strerror(errno));
+	}
+	
+	if (prussdrv_pru_attach_event_fd(host, fd) != 0) {
+		close(fd);
+		return Nan::ThrowError("PRU driver is not open. Did you forget to call init()?");
+	}
+}
+
+void stopInterruptWatchers(uv_loop_t* loop) {
+	for (unsigned int i = 0; i < NUM_PRU_HOSTIRQS; i++) {
+		stopWatcher(i, loop);
+	}
+}
@@ -0,0 +1,21 @@
+#ifndef _INTERRUPTS_H
+#define _INTERRUPTS_H
+
+#include <uv.h>
+#include <nan.h>
+
+NAN_METHOD(onInterrupt);
+NAN_METHOD(offInterrupt);
+NAN_METHOD(attachEventFd);
+
+//Close the interrupt subscriptions made on a loop, must run before the UIO fds are closed
+void stopInterruptWatchers(uv_loop_t* loop);
+
+//Cancel the waitForInterrupt() calls made on a loop, or all of them with NULL.
+//Any thread, defined with waitForInterrupt() in prussdrv.cpp
+void cancelPendingWaits(uv_loop_t* loop);
+
+//Block until the cancelled waits have left the driver, before it is closed
+void drainPendingWaits();
+
+#endif
@@ -0,0 +1,203 @@
+//System headers
+#include <string>
+
+//Node.js addon headers
+#include <uv.h>
+#include <node.h>
+#include <node_version.h>
+#include <node_buffer.h>
+#include <nan.h>
+
+#include "memory.h"
+#include "imagecache.h"
+#include "loader.h"
+
+using namespace v8;
+
+#define LOAD_EXECUTE	1
+#define LOAD_DATA		2
+
+/* One pending load
+ *	Only the file read and validation run on the threadpool, the device is written
+ *	from the loop thread so it never races the synchronous accessors.
+ */
+struct LoadRequest {
+	uv_work_t request;
+	int mode;
+	int pruNum;
+	size_t address;
+	bool verify;					//read IRAM back before trusting the resident image
+	size_t maxSize;
+	std::string path;				//empty when the image came from a Buffer
+	FirmwareImage image;
+	std::string error;
+	Nan::Persistent<Promise::Resolver> resolver;
+};
+
+static void LoadWork(uv_work_t* req) {
+	LoadRequest* load = static_cast<LoadRequest*>(req->data);
+	if (!load->path.empty()) {
+		loadImageFile(load->path, load->maxSize, &load->image, &load->error);
+	}
+}
+
+static void LoadAfter(uv_work_t* req, int status) {
+	Nan::HandleScope scope;
+	LoadRequest* load = static_cast<LoadRequest*>(req->data);
+	Local<Promise::Resolver> resolver = Nan::New(load->resolver);
+	
+	//Settling from a libuv callback needs a callback scope so the microtask queue is drained
+#if NODE_MAJOR_VERSION >= 9
+	node::CallbackScope callbackScope(Isolate::GetCurrent(), resolver, node::async_context{0, 0});
+#endif
+	
+	if (load->error.empty() && memRegions[REGION_DATARAM0].base == NULL) {
+		load->error = "PRU is not initialised";
+	}
+	
+	if (load->error.empty()) {
+		int rc;
+		if (load->mode == LOAD_EXECUTE) {
+			rc = executeImage(load->pruNum, load->image, load->address, load->verify);
+		} else {
+			rc = loadDataImage(load->pruNum, load->image);
+		}
+		if (rc != 0) {
+			load->error = load->mode == LOAD_EXECUTE ? "failed to execute PRU firmware" : "failed to load datafile";
+		}
+	}
+	
+	Maybe<bool> settled = Nothing<bool>();
+	if (load->error.empty()) {
+		settled = resolver->Resolve(Nan::GetCurrentContext(), Nan::Undefined());
+	} else {
+		settled = resolver->Reject(Nan::GetCurrentContext(), Nan::Error(load->error.c_str()));
+	}
+	
+	load->resolver.Reset();
+	delete load;
+	
+	//Settling only fails while the isolate is terminating, with no microtask left to run
+	if (settled.IsNothing()) {
+		return;
+	}
+	
+#if NODE_MAJOR_VERSION < 9
+	Isolate::GetCurrent()->RunMicrotasks();
+#endif
+}
+
+/* Parse (pru, file | Buffer) into a LoadRequest and queue it
+ *	Returns NULL with a pending exception on invalid arguments
+ */
+static LoadRequest* newLoad(Nan::NAN_METHOD_ARGS_TYPE info, int mode, size_t maxSize) {
+	if (!info[0]->IsNumber()) {
+		Nan::ThrowTypeError("PRU number must be Integer");
+		return NULL;
+	}
+	
+	int pruNum = info[0]->Int32Value();
+	if (pruNum != 0 && pruNum != 1) {
+		Nan::ThrowRangeError("PRU number must be 0 or 1");
+		return NULL;
+	}
+	
+	LoadRequest* load = new LoadRequest();
+	load->request.data = load;
+	load->mode = mode;
+	load->pruNum = pruNum;
+	load->address = 0;
+	load->verify = false;
+	load->maxSize = maxSize;
+	
+	if (info[1]->IsString()) {
+		String::Utf8Value path(info[1]->ToString());
+		load->path = std::string(*path);
+	} else if (node::Buffer::HasInstance(info[1])) {
+		//Copied so the caller may reuse the Buffer as soon as we return
+		size_t length = node::Buffer::Length(info[1]);
+		if (length == 0 || length > maxSize) {
+			delete load;
+			Nan::ThrowRangeError(("Image must be between 1 and " + std::to_string(maxSize) + " bytes").c_str());
+			return NULL;
+		}
+		loadImageData(node::Buffer::Data(info[1]), length, &load->image);
+	} else {
+		delete load;
+		Nan::ThrowTypeError("Image must be a filename or a Buffer");
+		return NULL;
+	}
+	
+	return load;
+}
+
+static void queueLoad(Nan::NAN_METHOD_ARGS_TYPE info, LoadRequest* load) {
+	Local<Promise::Resolver> resolver = Promise::Resolver::New(Nan::GetCurrentContext()).ToLocalChecked();
+	load->resolver.Reset(resolver);
+	uv_queue_work(Nan::GetCurrentEventLoop(), &load->request, LoadWork, LoadAfter);
+	info.GetReturnValue().Set(resolver->GetPromise());
+}
+
+/* Execute PRU program without blocking the event loop
+ *	The file is read on the threadpool, or taken from the image cache. The PRU is then
+ *	disabled, the words of IRAM that differ written and the PRU started at the address.
+ *
+ *	@param {number} PRU number
+ *	@param {string|Buffer} filename or in-memory image
+ *	@param {number} [address]
+ *	@param {boolean} [verify] read IRAM back first, when something outside this module may have written it
+ *	@returns {Promise}
+ */
+NAN_METHOD(executeAsync) {
+	Nan::HandleScope scope;
+	
+	if (info.Length() < 2 || info.Length() > 4) {
+		return Nan::ThrowTypeError("Wrong number of arguments");
+	}
+	
+	if (info.Length() >= 3 && !info[2]->IsNumber()) {
+		return Nan::ThrowTypeError("Address must be Integer");
+	}
+	
+	if (info.Length() == 4 && !info[3]->IsBoolean()) {
+		return Nan::ThrowTypeError("Verify must be Boolean");
+	}
+	
+	LoadRequest* load = newLoad(info, LOAD_EXECUTE, IRAM_SIZE);
+	if (load == NULL) {
+		return;
+	}
+	
+	if (info.Length() >= 3) {
+		load->address = info[2]->Uint32Value();
+	}
+	
+	if (info.Length() == 4) {
+		load->verify = info[3]->BooleanValue();
+	}
+	
+	queueLoad(info, load);
+}
+
+/* Load PRU data file without blocking the event loop
+ *	The file is read on the threadpool, or taken from the image cache, then written to
+ *	the start of the PRU's data RAM.
+ *
+ *	@param {number} PRU number
+ *	@param {string|Buffer} filename or in-memory image
+ *	@returns {Promise}
+ */
+NAN_METHOD(loadDatafileAsync) {
+	Nan::HandleScope scope;
+	
+	if (info.Length() != 2) {
+		return Nan::ThrowTypeError("Wrong number of arguments");
+	}
+	
+	LoadRequest* load = newLoad(info, LOAD_DATA, DATARAM_SIZE);
+	if (load == NULL) {
+		return;
+	}
+	
+	queueLoad(info, load);
+}
@@ -0,0 +1,9 @@
+#ifndef _LOADER_H
+#define _LOADER_H
+
+#include <nan.h>
+
+NAN_METHOD(executeAsync);
+NAN_METHOD(loadDatafileAsync);
+
+#endif
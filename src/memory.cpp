@@ -0,0 +1,354 @@
+//System headers
+#include <string>
+
+//PRU Driver headers
+#include <prussdrv.h>
+
+//Node.js addon headers
+#include <node_buffer.h>
+#include <nan.h>
+
+#include "memory.h"
+#include "context.h"
+
+using namespace v8;
+
+MemRegion memRegions[NUM_REGIONS];
+
+//bumped on init and exit, see memory.h
+unsigned int mappingGeneration = 0;
+
+/* Detach all zero-copy views of the thread
+ *	Called whenever the thread lets go of the mapping (exit, close) or replaces it (init),
+ *	so JS code holding on to an old view sees an empty buffer rather than a dangling pointer
+ */
+void invalidateMappedViews() {
+	Nan::HandleScope scope;
+	Nan::Persistent<v8::Object>* mappedViews = currentEnv()->mappedViews;
+	
+	for (unsigned int i = 0; i < NUM_REGIONS; i++) {
+		if (mappedViews[i].IsEmpty()) {
+			continue;
+		}
+		
+		Local<ArrayBuffer> ab = Nan::New(mappedViews[i]).As<Uint8Array>()->Buffer();
+#if V8_MAJOR_VERSION > 7 || (V8_MAJOR_VERSION == 7 && V8_MINOR_VERSION >= 3)
+		ab->Detach();
+#else
+		ab->Neuter();
+#endif
+		mappedViews[i].Reset();
+	}
+}
+
+void mapRegions() {
+	void* base;
+	
+	unmapRegions();
+	
+	prussdrv_map_prumem(PRUSS0_PRU0_DATARAM, &base);
+	memRegions[REGION_DATARAM0].base = (char*) base;
+	memRegions[REGION_DATARAM0].size = base ? DATARAM_SIZE : 0;
+	memRegions[REGION_DATARAM0].pru = 0;
+	
+	prussdrv_map_prumem(PRUSS0_PRU1_DATARAM, &base);
+	memRegions[REGION_DATARAM1].base = (char*) base;
+	memRegions[REGION_DATARAM1].size = base ? DATARAM_SIZE : 0;
+	memRegions[REGION_DATARAM1].pru = 1;
+	
+	if (prussdrv_map_prumem(PRUSS0_SHARED_DATARAM, &base) != 0) {
+		base = NULL;
+	}
+	memRegions[REGION_SHAREDRAM].base = (char*) base;
+	memRegions[REGION_SHAREDRAM].size = base ? SHAREDRAM_SIZE : 0;
+	memRegions[REGION_SHAREDRAM].pru = -1;
+	
+	// External DDR memory of the uio_pruss driver
+	prussdrv_map_extmem(&base);
+	memRegions[REGION_EXTRAM].base = (char*) base;
+	memRegions[REGION_EXTRAM].size = base ? prussdrv_extmem_size() : 0;
+	memRegions[REGION_EXTRAM].pru = -1;
+}
+
+void unmapRegions() {
+	for (unsigned int i = 0; i < NUM_REGIONS; i++) {
+		memRegions[i].base = NULL;
+		memRegions[i].size = 0;
+		memRegions[i].pru = -1;
+	}
+	
+	mappingGeneration++;
+}
+
+/* The memory is owned by the UIO mapping, never by V8 */
+static void noopFree(char* data, void* hint) {
+}
+
+/* Wrap a mapped region without copying
+ *	The Buffer is created once per region and cached, so repeated calls are free.
+ *	With a type name, a typed array over the same memory is returned instead.
+ */
+static Local<Value> mapView(unsigned int region, Local<Value> type) {
+	Nan::EscapableHandleScope scope;
+	char* base;
+	size_t size;
+	
+	//A view must not outlive the mapping, getRegion() only resolves for threads holding the driver
+	if (!getRegion(region, &base, &size)) {
+		Nan::ThrowError("PRU memory is not mapped. Did you forget to call init()?");
+		return scope.Escape(Nan::Undefined());
+	}
+	
+	//Zero-copy Buffers over the mapped memory, one per region and thread
+	Nan::Persistent<v8::Object>* mappedViews = currentEnv()->mappedViews;
+	if (mappedViews[region].IsEmpty()) {
+		Local<Object> buf = Nan::NewBuffer(base, size, noopFree, NULL).ToLocalChecked();
+		mappedViews[region].Reset(buf);
+	}
+	
+	Local<Object> buf = Nan::New(mappedViews[region]);
+	if (type->IsUndefined()) {
+		return scope.Escape(buf);
+	}
+	
+	if (!type->IsString()) {
+		Nan::ThrowTypeError("Type must be a string");
+		return scope.Escape(Nan::Undefined());
+	}
+	
+	Local<ArrayBuffer> ab = buf.As<Uint8Array>()->Buffer();
+	std::string typeS = std::string(*Nan::Utf8String(type));
+	if (typeS == "uint8") {
+		return scope.Escape(Uint8Array::New(ab, 0, size));
+	} else if (typeS == "int8") {
+		return scope.Escape(Int8Array::New(ab, 0, size));
+	} else if (typeS == "uint16") {
+		return scope.Escape(Uint16Array::New(ab, 0, size / 2));
+	} else if (typeS == "int16") {
+		return scope.Escape(Int16Array::New(ab, 0, size / 2));
+	} else if (typeS == "uint32") {
+		return scope.Escape(Uint32Array::New(ab, 0, size / 4));
+	} else if (typeS == "int32") {
+		return scope.Escape(Int32Array::New(ab, 0, size / 4));
+	} else if (typeS == "float32") {
+		return scope.Escape(Float32Array::New(ab, 0, size / 4));
+	}
+	
+	Nan::ThrowTypeError("Type must be one of uint8, int8, uint16, int16, uint32, int32, float32");
+	return scope.Escape(Nan::Undefined());
+}
+
+/* Map the shared PRU RAM into JS without copying
+ *	The view starts at the beginning of shared RAM, the shared RAM offset is not applied
+ *	Views become empty once exit() is called
+ *
+ *	@param {string} [type] typed array to return instead of a Buffer
+ */
+NAN_METHOD(mapSharedRAM) {
+	Nan::HandleScope scope;
+	
+	if (info.Length() > 1) {
+		return Nan::ThrowTypeError("Wrong number of arguments");
+	}
+	
+	info.GetReturnValue().Set(mapView(REGION_SHAREDRAM, info[0]));
+};
+
+/* Map the data RAM of a PRU into JS without copying
+ *	Views become empty once exit() is called
+ *
+ *	@param {number} PRU number
+ *	@param {string} [type] typed array to return instead of a Buffer
+ */
+NAN_METHOD(mapDataRAM) {
+	Nan::HandleScope scope;
+	
+	if (info.Length() < 1 || info.Length() > 2) {
+		return Nan::ThrowTypeError("Wrong number of arguments");
+	}
+	
+	if (!info[0]->IsNumber()) {
+		return Nan::ThrowTypeError("Argument must be a number");
+	}
+	
+	if (info[0]->NumberValue() != 0 && info[0]->NumberValue() != 1) {
+		return Nan::ThrowRangeError("PRU number must be 0 or 1");
+	}
+	
+	if (info[0]->Int32Value() == 0) {
+		info.GetReturnValue().Set(mapView(REGION_DATARAM0, info[1]));
+	} else {
+		info.GetReturnValue().Set(mapView(REGION_DATARAM1, info[1]));
+	}
+};
+
+/* Map the DDR external memory of the uio_pruss driver into JS without copying
+ *	Its size is set by the extram_pool_sz module parameter, 256KB by default
+ *	Views become empty once exit() is called
+ *
+ *	@param {string} [type] typed array to return instead of a Buffer
+ */
+NAN_METHOD(mapExtRAM) {
+	Nan::HandleScope scope;
+	
+	if (info.Length() > 1) {
+		return Nan::ThrowTypeError("Wrong number of arguments");
+	}
+	
+	info.GetReturnValue().Set(mapView(REGION_EXTRAM, info[0]));
+};
+
+/* Physical address of a location in a memory region, as the PRU addresses it over the L3
+ *	This is what firmware needs to be told to reach the external memory
+ *
+ *	@param {number} region, one of DATARAM0, DATARAM1, SHAREDRAM, EXTRAM
+ *	@param {number} [offset] byte offset from the start of the region
+ */
+NAN_METHOD(getPhysAddr) {
+	Nan::HandleScope scope;
+	
+	if (info.Length() < 1 || info.Length() > 2) {
+		return Nan::ThrowTypeError("Wrong number of arguments");
+	}
+	
+	if (!info[0]->IsNumber() || (info.Length() > 1 && !info[1]->IsNumber())) {
+		return Nan::ThrowTypeError("Region and offset must be Integer");
+	}
+	
+	uint32_t region = info[0]->Uint32Value();
+	uint32_t offset = info.Length() > 1 ? info[1]->Uint32Value() : 0;
+	if (!inRegion(region, offset, 1)) {
+		return Nan::ThrowRangeError("Offset out of range for this region");
+	}
+	
+	info.GetReturnValue().Set(Nan::New<Number>(prussdrv_get_phys_addr(memRegions[region].base + offset)));
+};
+
+/* Resolve (region, byte offset) arguments to an address for an access of type T
+ *	A single range check covers unknown regions, unmapped regions and offsets past
+ *	the end. Offsets must be aligned to the access size (at most 4), since unaligned
+ *	accesses to the uncached PRU mapping fault on ARM.
+ *	Returns NULL with a pending exception on failure
+ */
+template<typename T>
+static inline volatile T* typedAddress(Nan::NAN_METHOD_ARGS_TYPE info) {
+	const uint32_t align = sizeof(T) < 4 ? sizeof(T) : 4;
+	
+	if (!info[0]->IsNumber() || !info[1]->IsNumber()) {
+		Nan::ThrowTypeError("Region and offset must be Integer");
+		return NULL;
+	}
+	
+	uint32_t region = info[0]->Uint32Value();
+	uint32_t offset = info[1]->Uint32Value();
+	if (!inRegion(region, offset, sizeof(T)) || (offset & (align - 1)) != 0) {
+		Nan::ThrowRangeError("Offset out of range or misaligned for this region");
+		return NULL;
+	}
+	
+	return (volatile T*) (memRegions[region].base + offset);
+}
+
+template<typename T>
+static inline void readTyped(Nan::NAN_METHOD_ARGS_TYPE info) {
+	if (info.Length() != 2) {
+		return Nan::ThrowTypeError("Wrong number of arguments");
+	}
+	
+	volatile T* addr = typedAddress<T>(info);
+	if (addr != NULL) {
+		info.GetReturnValue().Set(Nan::New<Number>(*addr));
+	}
+}
+
+//JS number conversion per access type, with the usual ToUint32/ToInt32 wrapping
+static inline void fromValue(Local<Value> v, uint8_t* out) { *out = v->Uint32Value(); }
+static inline void fromValue(Local<Value> v, uint16_t* out) { *out = v->Uint32Value(); }
+static inline void fromValue(Local<Value> v, uint32_t* out) { *out = v->Uint32Value(); }
+static inline void fromValue(Local<Value> v, int32_t* out) { *out = v->Int32Value(); }
+static inline void fromValue(Local<Value> v, float* out) { *out = (float) v->NumberValue(); }
+
+template<typename T>
+static inline void writeTyped(Nan::NAN_METHOD_ARGS_TYPE info) {
+	T value;
+	
+	if (info.Length() != 3) {
+		return Nan::ThrowTypeError("Wrong number of arguments");
+	}
+	
+	if (!info[2]->IsNumber()) {
+		return Nan::ThrowTypeError("Value must be a number");
+	}
+	
+	volatile T* addr = typedAddress<T>(info);
+	if (addr != NULL) {
+		fromValue(info[2], &value);
+		*addr = value;
+	}
+}
+
+/* Read 64 bits as two word accesses, low word first
+ *	The words are not read atomically with respect to the PRU
+ */
+static inline bool read64(Nan::NAN_METHOD_ARGS_TYPE info, uint64_t* value) {
+	if (info.Length() != 2) {
+		Nan::ThrowTypeError("Wrong number of arguments");
+		return false;
+	}
+	
+	volatile uint32_t* addr = (volatile uint32_t*) typedAddress<uint64_t>(info);
+	if (addr == NULL) {
+		return false;
+	}
+	
+	uint32_t lo = addr[0];
+	uint32_t hi = addr[1];
+	*value = ((uint64_t) hi << 32) | lo;
+	return true;
+}
+
+/* Typed reads
+ *	@param {number} region, one of DATARAM0, DATARAM1, SHAREDRAM, EXTRAM
+ *	@param {number} byte offset from the start of the region
+ */
+NAN_METHOD(readUInt8) { readTyped<uint8_t>(info); }
+NAN_METHOD(readUInt16) { readTyped<uint16_t>(info); }
+NAN_METHOD(readUInt32) { readTyped<uint32_t>(info); }
+NAN_METHOD(readInt32) { readTyped<int32_t>(info); }
+NAN_METHOD(readFloat) { readTyped<float>(info); }
+
+/* 64 bit reads return a BigInt where V8 has them, a Number (exact up to 2^53) otherwise */
+NAN_METHOD(readUInt64) {
+	uint64_t value;
+	if (!read64(info, &value)) {
+		return;
+	}
+#if V8_MAJOR_VERSION > 6 || (V8_MAJOR_VERSION == 6 && V8_MINOR_VERSION >= 8)
+	info.GetReturnValue().Set(BigInt::NewFromUnsigned(info.GetIsolate(), value));
+#else
+	info.GetReturnValue().Set(Nan::New<Number>((double) value));
+#endif
+}
+
+NAN_METHOD(readInt64) {
+	uint64_t value;
+	if (!read64(info, &value)) {
+		return;
+	}
+#if V8_MAJOR_VERSION > 6 || (V8_MAJOR_VERSION == 6 && V8_MINOR_VERSION >= 8)
+	info.GetReturnValue().Set(BigInt::New(info.GetIsolate(), (int64_t) value));
+#else
+	info.GetReturnValue().Set(Nan::New<Number>((double) (int64_t) value));
+#endif
+}
+
+/* Typed writes
+ *	@param {number} region, one of DATARAM0, DATARAM1, SHAREDRAM, EXTRAM
+ *	@param {number} byte offset from the start of the region
+ *	@param {number} value
+ */
+NAN_METHOD(writeUInt8) { writeTyped<uint8_t>(info); }
+NAN_METHOD(writeUInt16) { writeTyped<uint16_t>(info); }
+NAN_METHOD(writeUInt32) { writeTyped<uint32_t>(info); }
+NAN_METHOD(writeInt32) { writeTyped<int32_t>(info); }
+NAN_METHOD(writeFloat) { writeTyped<float>(info); }
@@ -0,0 +1,84 @@
+#ifndef _MEMORY_H
+#define _MEMORY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <nan.h>
+
+//AM33XX memory sizes in bytes
+#define DATARAM_SIZE	8192
+#define SHAREDRAM_SIZE	12288
+
+//Memory regions, as exposed to JS
+#define REGION_DATARAM0		0
+#define REGION_DATARAM1		1
+#define REGION_SHAREDRAM	2
+#define REGION_EXTRAM		3
+#define NUM_REGIONS			4
+
+/* Descriptor of a mapped memory region
+ *	Unmapped regions have a NULL base and a size of 0, so bounds checks
+ *	against them always fail without a separate test.
+ */
+struct MemRegion {
+	char* base;
+	size_t size;
+	int pru;	//PRU owning the region, -1 if it is shared
+};
+
+//Built by mapRegions() when the driver is opened, indexed by REGION_*
+//Process-wide, written only while no context holds the driver, see session.h
+extern MemRegion memRegions[NUM_REGIONS];
+
+//Incremented whenever the mapping is replaced or torn down, objects holding
+//pointers into PRU memory compare it to detect that they have gone stale
+extern unsigned int mappingGeneration;
+
+//Fill the region table from the driver, after prussdrv_open()
+void mapRegions();
+
+//Empty the region table, before prussdrv_exit()
+void unmapRegions();
+
+//Detach the zero-copy views of the calling thread, once it no longer holds the driver
+void invalidateMappedViews();
+
+//Whether the calling thread holds a session reference, defined in context.cpp
+//The mapping is process-wide, but only such a thread can rely on it staying in place
+bool threadHoldsDriver();
+
+//Resolve a region to its mapped base address and size in bytes
+//Returns false if the region is unknown or not mapped, or the thread doesn't hold the driver
+inline bool getRegion(unsigned int region, char** base, size_t* size) {
+	if (region >= NUM_REGIONS || memRegions[region].base == NULL || !threadHoldsDriver()) {
+		return false;
+	}
+	*base = memRegions[region].base;
+	*size = memRegions[region].size;
+	return true;
+}
+
+//Check that [offset, offset + length) lies inside a region the thread may access
+inline bool inRegion(unsigned int region, uint64_t offset, uint64_t length) {
+	return region < NUM_REGIONS && offset + length <= memRegions[region].size && threadHoldsDriver();
+}
+
+NAN_METHOD(mapSharedRAM);
+NAN_METHOD(mapDataRAM);
+NAN_METHOD(mapExtRAM);
+NAN_METHOD(getPhysAddr);
+NAN_METHOD(readUInt8);
+NAN_METHOD(readUInt16);
+NAN_METHOD(readUInt32);
+NAN_METHOD(readInt32);
+NAN_METHOD(readFloat);
+NAN_METHOD(readUInt64);
+NAN_METHOD(readInt64);
+NAN_METHOD(writeUInt8);
+NAN_METHOD(writeUInt16);
+NAN_METHOD(writeUInt32);
+NAN_METHOD(writeInt32);
+NAN_METHOD(writeFloat);
+
+#endif
@@ -0,0 +1,324 @@
+//System headers
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <vector>
+#include <algorithm>
+#include <functional>
+
+//PRU Driver headers
+#include <prussdrv.h>
+
+//Node.js addon headers
+#include <uv.h>
+#include <nan.h>
+
+#include "memory.h"
+#include "imagecache.h"
+#include "profiler.h"
+
+using namespace v8;
+
+//PRU core clock of the AM33xx, for utilization
+#define PRU_CLOCK_HZ		200000000.0
+
+//Instruction words in IRAM, the range of the program counter
+#define IRAM_WORDS			(IRAM_SIZE / 4)
+
+//CYCLE stops here instead of wrapping, about 21 s after it was reset
+#define COUNTER_SATURATED	0xFFFFFFFFu
+
+//Hottest addresses reported by profile()
+#define HOT_SPOTS			16
+
+/* Samples of one PRU
+ *	Written by the sampling thread under profileLock, read by profile() under the same lock
+ */
+struct PruProfile {
+	bool active;
+	volatile uint32_t* control;
+	std::vector<uint32_t> histogram;	//running samples per instruction word
+	uint64_t samples;
+	uint64_t running;
+	uint64_t sleeping;
+	uint64_t halted;
+	uint64_t cycles;
+	uint64_t stalls;
+	uint32_t lastCycle;
+	uint32_t lastStall;
+	bool saturated;		//CYCLE stopped, cycles and stalls no longer grow
+	bool counting;		//COUNTER_ENABLE at the last sample, a restart of the PRU clears it
+	uint64_t since;		//uv_hrtime() the window started
+};
+
+static PruProfile profiles[2];
+static uv_mutex_t profileLock;
+static uv_once_t profilerOnce = UV_ONCE_INIT;
+
+//The sampler is process-wide, started and stopped from any thread under samplerLock.
+//Taken before profileLock, and never held by the sampling thread.
+static uv_mutex_t samplerLock;
+static pthread_t samplerThread;
+static bool sampling = false;
+static volatile bool stopSampling = false;
+static uint64_t sampleInterval;	//ns
+
+static void resetProfile(PruProfile* p) {
+	p->histogram.assign(IRAM_WORDS, 0);
+	p->samples = p->running = p->sleeping = p->halted = 0;
+	p->cycles = p->stalls = 0;
+	p->saturated = false;
+	p->counting = true;
+	p->since = uv_hrtime();
+}
+
+/* Take one sample of a PRU
+ *	CYCLE and STALL are accumulated as deltas, a counter smaller than last time means
+ *	something else reset it, so its whole value is new.
+ *	CONTROL is only read: the PRU clears ENABLE itself when it runs HALT, and a
+ *	read-modify-write racing with that would start it again. A saturated or disabled
+ *	counter is reported by profile() instead.
+ */
+static void sample(PruProfile* p) {
+	volatile uint32_t* regs = p->control;
+	uint32_t control = regs[PRU_CONTROL_REG / 4];
+	uint32_t pc = regs[PRU_STATUS_REG / 4] & PRU_STATUS_PCOUNTER_MASK;
+	uint32_t cycle = regs[PRU_CYCLE_REG / 4];
+	uint32_t stall = regs[PRU_STALL_REG / 4];
+	
+	p->samples++;
+	if (!(control & PRU_CONTROL_RUNSTATE)) {
+		p->halted++;
+	} else if (control & PRU_CONTROL_SLEEPING) {
+		p->sleeping++;
+	} else {
+		p->running++;
+		if (pc < IRAM_WORDS) {
+			p->histogram[pc]++;
+		}
+	}
+	
+	p->cycles += cycle >= p->lastCycle ? cycle - p->lastCycle : cycle;
+	p->stalls += stall >= p->lastStall ? stall - p->lastStall : stall;
+	p->lastCycle = cycle;
+	p->lastStall = stall;
+	p->saturated = cycle == COUNTER_SATURATED;
+	p->counting = (control & PRU_CONTROL_COUNTER_ENABLE) != 0;
+}
+
+/* Body of the sampling thread
+ *	Wakes on an absolute schedule, so the sampling rate doesn't drift with the time a sample takes
+ */
+static void* samplerMain(void* arg) {
+	struct timespec next;
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	
+	while (!stopSampling) {
+		next.tv_nsec += sampleInterval;
+		while (next.tv_nsec >= 1000000000) {
+			next.tv_nsec -= 1000000000;
+			next.tv_sec++;
+		}
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR) {
+		}
+		
+		uv_mutex_lock(&profileLock);
+		for (unsigned int i = 0; i < 2; i++) {
+			if (profiles[i].active) {
+				sample(&profiles[i]);
+			}
+		}
+		uv_mutex_unlock(&profileLock);
+	}
+	return NULL;
+}
+
+static void initLocks() {
+	uv_mutex_init(&profileLock);
+	uv_mutex_init(&samplerLock);
+}
+
+//With samplerLock held
+static void stopSampler() {
+	if (sampling) {
+		stopSampling = true;
+		pthread_join(samplerThread, NULL);
+		sampling = false;
+	}
+}
+
+void stopProfiling() {
+	uv_once(&profilerOnce, initLocks);
+	uv_mutex_lock(&samplerLock);
+	stopSampler();
+	uv_mutex_unlock(&samplerLock);
+}
+
+/* Start sampling the program counter and the CYCLE and STALL counters
+ *	A background thread reads the control registers of each PRU every interval
+ *	microseconds. This needs no support from the firmware. CYCLE and STALL are reset and
+ *	enabled here, the only write to CONTROL: they stop about 21 s later, and restarting
+ *	the PRU turns them off, see saturated and counting in profile(). Starting again
+ *	restarts the profile.
+ *
+ *	@param {object} [options] { pru: 0, 1 or [0, 1] (default), interval: microseconds, 100 by default }
+ */
+NAN_METHOD(startProfiler) {
+	Nan::HandleScope scope;
+	bool active[2] = { true, true };
+	uint32_t interval = 100;
+	
+	if (info.Length() > 1 || (info.Length() == 1 && !info[0]->IsObject())) {
+		return Nan::ThrowTypeError("Argument must be an options object");
+	}
+	
+	if (info.Length() == 1) {
+		Local<Object> options = info[0]->ToObject();
+		Local<Value> pru = Nan::Get(options, Nan::New("pru").ToLocalChecked()).ToLocalChecked();
+		Local<Value> intervalOption = Nan::Get(options, Nan::New("interval").ToLocalChecked()).ToLocalChecked();
+		
+		if (pru->IsNumber()) {
+			if (pru->Uint32Value() > 1) {
+				return Nan::ThrowRangeError("PRU number must be 0 or 1");
+			}
+			active[0] = pru->Uint32Value() == 0;
+			active[1] = pru->Uint32Value() == 1;
+		} else if (pru->IsArray()) {
+			Local<Array> list = Local<Array>::Cast(pru);
+			active[0] = active[1] = false;
+			for (uint32_t i = 0; i < list->Length(); i++) {
+				Local<Value> item = Nan::Get(list, i).ToLocalChecked();
+				if (!item->IsNumber() || item->Uint32Value() > 1) {
+					return Nan::ThrowRangeError("PRU number must be 0 or 1");
+				}
+				active[item->Uint32Value()] = true;
+			}
+		} else if (!pru->IsUndefined()) {
+			return Nan::ThrowTypeError("pru must be a PRU number or an array of them");
+		}
+		
+		if (!intervalOption->IsUndefined()) {
+			if (!intervalOption->IsNumber() || intervalOption->NumberValue() < 1 || intervalOption->NumberValue() > 1000000) {
+				return Nan::ThrowRangeError("interval must be 1 to 1000000 microseconds");
+			}
+			interval = intervalOption->Uint32Value();
+		}
+	}
+	
+	if (memRegions[REGION_DATARAM0].base == NULL) {
+		return Nan::ThrowError("PRU memory is not mapped. Did you forget to call init()?");
+	}
+	
+	uv_once(&profilerOnce, initLocks);
+	uv_mutex_lock(&samplerLock);
+	stopSampler();
+	
+	uv_mutex_lock(&profileLock);
+	for (unsigned int i = 0; i < 2; i++) {
+		void* control = NULL;
+		profiles[i].active = active[i] && prussdrv_map_pru_control(i, &control) == 0;
+		profiles[i].control = (volatile uint32_t*) control;
+		resetProfile(&profiles[i]);
+		if (profiles[i].active) {
+			prussdrv_pru_reset_counters(i);
+			profiles[i].lastCycle = profiles[i].lastStall = 0;
+		}
+	}
+	uv_mutex_unlock(&profileLock);
+	
+	sampleInterval = (uint64_t) interval * 1000;
+	stopSampling = false;
+	int rc = pthread_create(&samplerThread, NULL, samplerMain, NULL);
+	sampling = rc == 0;
+	uv_mutex_unlock(&samplerLock);
+	
+	if (rc != 0) {
+		return Nan::ThrowError(strerror(rc));
+	}
+}
+
+/* Stop sampling, the profile taken so far can still be read */
+NAN_METHOD(stopProfiler) {
+	stopProfiling();
+}
+
+/* Get the profile of each PRU
+ *	Rates are per second of the profiling window, utilization is the share of the 200MHz
+ *	clock the PRU spent enabled and busy is the share of samples it was neither halted nor
+ *	asleep. hot lists the instruction addresses (in bytes, as for execute()) the most
+ *	samples landed on, histogram has the samples of every instruction word.
+ *
+ *	@param {boolean} [reset] start a new window after reading
+ *	@returns {array} per PRU: { samples, running, sleeping, halted, elapsed, cycles, stalls,
+ *		cyclesPerSecond, stallsPerSecond, utilization, busy, saturated, counting,
+ *		hot: [{ address, samples }], histogram }
+ */
+NAN_METHOD(profile) {
+	Nan::HandleScope scope;
+	Local<Array> result = Nan::New<Array>(2);
+	
+	uv_once(&profilerOnce, initLocks);
+	uv_mutex_lock(&profileLock);
+	if (profiles[0].histogram.empty()) {
+		uv_mutex_unlock(&profileLock);
+		return Nan::ThrowError("The profiler was never started");
+	}
+	
+	uint64_t now = uv_hrtime();
+	for (unsigned int i = 0; i < 2; i++) {
+		PruProfile* p = &profiles[i];
+		if (!p->active) {
+			Nan::Set(result, i, Nan::Null());
+			continue;
+		}
+		
+		double elapsed = (now - p->since) / 1e9;
+		Local<Object> pru = Nan::New<Object>();
+		Nan::Set(pru, Nan::New("samples").ToLocalChecked(), Nan::New<Number>(p->samples));
+		Nan::Set(pru, Nan::New("running").ToLocalChecked(), Nan::New<Number>(p->running));
+		Nan::Set(pru, Nan::New("sleeping").ToLocalChecked(), Nan::New<Number>(p->sleeping));
+		Nan::Set(pru, Nan::New("halted").ToLocalChecked(), Nan::New<Number>(p->halted));
+		Nan::Set(pru, Nan::New("elapsed").ToLocalChecked(), Nan::New<Number>(elapsed));
+		Nan::Set(pru, Nan::New("cycles").ToLocalChecked(), Nan::New<Number>(p->cycles));
+		Nan::Set(pru, Nan::New("stalls").ToLocalChecked(), Nan::New<Number>(p->stalls));
+		Nan::Set(pru, Nan::New("cyclesPerSecond").ToLocalChecked(), Nan::New<Number>(elapsed > 0 ? p->cycles / elapsed : 0));
+		Nan::Set(pru, Nan::New("stallsPerSecond").ToLocalChecked(), Nan::New<Number>(elapsed > 0 ? p->stalls / elapsed : 0));
+		Nan::Set(pru, Nan::New("utilization").ToLocalChecked(), Nan::New<Number>(elapsed > 0 ? p->cycles / elapsed / PRU_CLOCK_HZ : 0));
+		Nan::Set(pru, Nan::New("busy").ToLocalChecked(), Nan::New<Number>(p->samples ? (double) p->running / p->samples : 0));
+		Nan::Set(pru, Nan::New("saturated").ToLocalChecked(), Nan::New<Boolean>(p->saturated));
+		Nan::Set(pru, Nan::New("counting").ToLocalChecked(), Nan::New<Boolean>(p->counting));
+		
+		//Partial sort of the addresses that were hit at all
+		std::vector<std::pair<uint32_t, uint32_t> > hits;
+		for (uint32_t pc = 0; pc < IRAM_WORDS; pc++) {
+			if (p->histogram[pc] != 0) {
+				hits.push_back(std::make_pair(p->histogram[pc], pc));
+			}
+		}
+		size_t top = std::min(hits.size(), (size_t) HOT_SPOTS);
+		std::partial_sort(hits.begin(), hits.begin() + top, hits.end(), std::greater<std::pair<uint32_t, uint32_t> >());
+		
+		Local<Array> hot = Nan::New<Array>(top);
+		for (size_t j = 0; j < top; j++) {
+			Local<Object> spot = Nan::New<Object>();
+			Nan::Set(spot, Nan::New("address").ToLocalChecked(), Nan::New<Number>(hits[j].second * 4));
+			Nan::Set(spot, Nan::New("samples").ToLocalChecked(), Nan::New<Number>(hits[j].first));
+			Nan::Set(hot, j, spot);
+		}
+		Nan::Set(pru, Nan::New("hot").ToLocalChecked(), hot);
+		
+		Local<ArrayBuffer> ab = ArrayBuffer::New(info.GetIsolate(), IRAM_WORDS * 4);
+		memcpy(ab->GetContents().Data(), &p->histogram[0], IRAM_WORDS * 4);
+		Nan::Set(pru, Nan::New("histogram").ToLocalChecked(), Uint32Array::New(ab, 0, IRAM_WORDS));
+		
+		if (info.Length() > 0 && info[0]->BooleanValue()) {
+			resetProfile(p);
+		}
+		Nan::Set(result, i, pru);
+	}
+	uv_mutex_unlock(&profileLock);
+	
+	info.GetReturnValue().Set(result);
+}
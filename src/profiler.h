@@ -0,0 +1,13 @@
+#ifndef _PROFILER_H
+#define _PROFILER_H
+
+#include <nan.h>
+
+NAN_METHOD(startProfiler);
+NAN_METHOD(stopProfiler);
+NAN_METHOD(profile);
+
+//Join the sampling thread, must run before the PRUSS is unmapped
+void stopProfiling();
+
+#endif
@@ -0,0 +1,39 @@
+/*
+ * pru_handler.h
+ *
+ * Interface of native interrupt handler plugins, for onInterrupt(host, { plugin }, cb).
+ *
+ * A plugin is a shared library exporting
+ *
+ *	int pru_interrupt_handler(struct pru_handler_context *ctx);
+ *
+ * (or another name given as symbol). It runs on the dedicated interrupt thread,
+ * right after each interrupt is read, and must not block or call into Node.js.
+ * Returning non-zero asks for the JS callback to be notified; notifications
+ * are still coalesced and counted against the notify option.
+ */
+
+#ifndef _PRU_HANDLER_H
+#define _PRU_HANDLER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define PRU_HANDLER_REGIONS	4	/* DATARAM0, DATARAM1, SHAREDRAM, EXTRAM */
+
+struct pru_handler_context {
+	unsigned int host;					/* PRU_EVTOUT_n that fired */
+	uint32_t count;						/* UIO running count of the interrupt */
+	volatile void *region_base[PRU_HANDLER_REGIONS];
+	size_t region_size[PRU_HANDLER_REGIONS];
+	int (*send_event)(unsigned int event);
+	int (*clear_event)(unsigned int host, unsigned int event);
+	/* Queue bytes for the next JS callback, returns 0 if the capture buffer is full */
+	int (*capture)(struct pru_handler_context *ctx, const void *data, size_t len);
+	void *user;							/* free for the plugin, kept across calls */
+	void *internal;
+};
+
+typedef int (*pru_interrupt_handler_fn)(struct pru_handler_context *ctx);
+
+#endif
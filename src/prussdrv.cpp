@@ -7,11 +7,15 @@
 #include <string>
 #include <cstring>
 #include <pthread.h>
+#include <climits>
+#include <vector>
+#include <algorithm>
+#include <sys/eventfd.h>
 
 //PRU Driver headers
 #include <prussdrv.h>
 #include <pruss_intc_mapping.h>	 
-#define OFFSET_SHAREDRAM_DEFAULT 2048
+#include <pruss_copy.h>
 
 #define X_INT		1
 #define X_BYTE		2
@@ -26,17 +30,23 @@
 #include <node_buffer.h>
 #include <nan.h>
 
-//shared memory pointer
-static unsigned int* sharedMem_int;
-
-//data memory pointers
-static unsigned int* dataMem_pru0_int;
-static unsigned int* dataMem_pru1_int;
-
-//offset to be used
-unsigned int offset_sharedRam = OFFSET_SHAREDRAM_DEFAULT;
+#include "memory.h"
+#include "interrupts.h"
+#include "ring.h"
+#include "blockstream.h"
+#include "batch.h"
+#include "loader.h"
+#include "imagecache.h"
+#include "stats.h"
+#include "profiler.h"
+#include "control.h"
+#include "seqlock.h"
+#include "watch.h"
+#include "session.h"
+#include "context.h"
 
 NAN_METHOD(InitPRU);
+NAN_METHOD(isSimulated);
 NAN_METHOD(loadDatafile);
 NAN_METHOD(executeProgram);
 NAN_METHOD(setSharedRAMOffset);
@@ -64,31 +74,236 @@ NAN_METHOD(forceExit);
 //using v8::Local;
 using namespace v8;
 
+/* Read a list of host interrupts (PRU_EVTOUT_0..7) into hosts
+ *	Returns false with a pending exception on invalid input
+ */
+static bool parseHostList(Local<Value> value, unsigned int* hosts, unsigned int* numHosts) {
+	if (!value->IsArray()) {
+		Nan::ThrowTypeError("Host interrupts must be an array");
+		return false;
+	}
+	
+	Local<Array> a = Local<Array>::Cast(value);
+	if (a->Length() < 1 || a->Length() > NUM_PRU_HOSTIRQS) {
+		Nan::ThrowRangeError("Between 1 and 8 host interrupts can be opened");
+		return false;
+	}
+	
+	for (unsigned int i = 0; i < a->Length(); i++) {
+		Local<Value> element = a->Get(i);
+		if (!element->IsNumber() || element->Uint32Value() >= NUM_PRU_HOSTIRQS) {
+			Nan::ThrowRangeError("Host interrupts must be integers from 0 to 7");
+			return false;
+		}
+		hosts[(*numHosts)++] = element->Uint32Value();
+	}
+	return true;
+}
+
+/* Read a list of [from, to] pairs of an INTC mapping option
+ *	Each "from" may appear only once, values must be below maxFrom / maxTo
+ *	Returns false with a pending exception on invalid input
+ */
+static bool parseIntcPairs(Local<Value> value, const char* name, int maxFrom, int maxTo, short (*pairs)[2], unsigned int maxPairs, unsigned int* numPairs) {
+	std::string nameS = std::string(name);
+	bool seen[NUM_PRU_SYS_EVTS] = { false };
+	
+	if (!value->IsArray()) {
+		Nan::ThrowTypeError((nameS + " must be an array of [from, to] pairs").c_str());
+		return false;
+	}
+	
+	Local<Array> a = Local<Array>::Cast(value);
+	if (a->Length() > maxPairs) {
+		Nan::ThrowRangeError((nameS + " has too many entries").c_str());
+		return false;
+	}
+	
+	for (unsigned int i = 0; i < a->Length(); i++) {
+		Local<Value> element = a->Get(i);
+		if (!element->IsArray() || Local<Array>::Cast(element)->Length() != 2) {
+			Nan::ThrowTypeError((nameS + " must be an array of [from, to] pairs").c_str());
+			return false;
+		}
+		
+		Local<Value> from = Local<Array>::Cast(element)->Get(0);
+		Local<Value> to = Local<Array>::Cast(element)->Get(1);
+		if (!from->IsNumber() || !to->IsNumber()) {
+			Nan::ThrowTypeError((nameS + " entries must be Integer").c_str());
+			return false;
+		}
+		
+		int fromI = from->Int32Value();
+		int toI = to->Int32Value();
+		if (fromI < 0 || fromI >= maxFrom || toI < 0 || toI >= maxTo) {
+			Nan::ThrowRangeError((nameS + " entry out of range").c_str());
+			return false;
+		}
+		
+		if (seen[fromI]) {
+			Nan::ThrowError((nameS + " maps the same entry twice").c_str());
+			return false;
+		}
+		seen[fromI] = true;
+		
+		pairs[i][0] = fromI;
+		pairs[i][1] = toI;
+	}
+	
+	*numPairs = a->Length();
+	return true;
+}
+
+/* Build the INTC setup from init() options
+ *	{ sysevtToChannel: [[19, 2], ...], channelToHost: [[2, 2], ...], hostEnableMask: 0x0F, hosts: [0] }
+ *	Hosts in channelToHost and hostEnableMask use INTC numbering (0/1: PRU0/1, 2..9: PRU_EVTOUT_0..7),
+ *	hosts to open use PRU_EVTOUT numbering. Missing mapping options keep PRUSS_INTC_INITDATA.
+ *	Returns false with a pending exception on invalid input
+ */
+static bool parseIntcOptions(Local<Object> options, tpruss_intc_initdata* intc, unsigned int* hosts, unsigned int* numHosts) {
+	Local<Value> sysevtToChannel = Nan::Get(options, Nan::New("sysevtToChannel").ToLocalChecked()).ToLocalChecked();
+	Local<Value> channelToHost = Nan::Get(options, Nan::New("channelToHost").ToLocalChecked()).ToLocalChecked();
+	Local<Value> hostEnableMask = Nan::Get(options, Nan::New("hostEnableMask").ToLocalChecked()).ToLocalChecked();
+	Local<Value> hostList = Nan::Get(options, Nan::New("hosts").ToLocalChecked()).ToLocalChecked();
+	short pairs[NUM_PRU_SYS_EVTS][2];
+	unsigned int numPairs, i;
+	
+	if (sysevtToChannel->IsUndefined() != channelToHost->IsUndefined()) {
+		Nan::ThrowTypeError("sysevtToChannel and channelToHost must be given together");
+		return false;
+	}
+	
+	if (!sysevtToChannel->IsUndefined()) {
+		bool channelMapped[NUM_PRU_CHANNELS] = { false };
+		
+		memset(intc, -1, sizeof(*intc));
+		
+		if (!parseIntcPairs(channelToHost, "channelToHost", NUM_PRU_CHANNELS, NUM_PRU_HOSTS, pairs, NUM_PRU_CHANNELS, &numPairs)) {
+			return false;
+		}
+		intc->host_enable_bitmask = 0;
+		for (i = 0; i < numPairs; i++) {
+			intc->channel_to_host_map[i].channel = pairs[i][0];
+			intc->channel_to_host_map[i].host = pairs[i][1];
+			intc->host_enable_bitmask |= 1 << pairs[i][1];
+			channelMapped[pairs[i][0]] = true;
+		}
+		
+		if (!parseIntcPairs(sysevtToChannel, "sysevtToChannel", NUM_PRU_SYS_EVTS, NUM_PRU_CHANNELS, pairs, NUM_PRU_SYS_EVTS, &numPairs)) {
+			return false;
+		}
+		for (i = 0; i < numPairs; i++) {
+			if (!channelMapped[pairs[i][1]]) {
+				Nan::ThrowError("sysevtToChannel uses a channel that channelToHost does not map to a host");
+				return false;
+			}
+			intc->sysevt_to_channel_map[i].sysevt = pairs[i][0];
+			intc->sysevt_to_channel_map[i].channel = pairs[i][1];
+			intc->sysevts_enabled[i] = pairs[i][0];
+		}
+	}
+	
+	if (!hostEnableMask->IsUndefined()) {
+		if (!hostEnableMask->IsNumber() || hostEnableMask->Uint32Value() >= (1 << NUM_PRU_HOSTS)) {
+			Nan::ThrowRangeError("hostEnableMask must be a 10 bit mask");
+			return false;
+		}
+		intc->host_enable_bitmask = hostEnableMask->Uint32Value();
+	}
+	
+	if (!hostList->IsUndefined()) {
+		return parseHostList(hostList, hosts, numHosts);
+	}
+	
+	//Open every PRU_EVTOUT host that is enabled
+	for (i = 0; i < NUM_PRU_HOSTIRQS; i++) {
+		if (intc->host_enable_bitmask & (1 << (i + 2))) {
+			hosts[(*numHosts)++] = i;
+		}
+	}
+	return true;
+}
+
+/* Read the argument of init() or new Pru()
+ *	undefined, a list of host interrupts or an options object, see InitPRU
+ *	Returns false with a pending exception on invalid input
+ */
+bool parseInitOptions(Local<Value> value, SessionOptions* options) {
+	tpruss_intc_initdata defaults = PRUSS_INTC_INITDATA;
+	
+	options->intc = defaults;
+	options->numHosts = 0;
+	options->simulate = -1;
+	options->customIntc = false;
+	
+	if (value->IsArray()) {
+		if (!parseHostList(value, options->hosts, &options->numHosts)) {
+			return false;
+		}
+	} else if (value->IsObject()) {
+		Local<Object> o = value->ToObject();
+		if (!parseIntcOptions(o, &options->intc, options->hosts, &options->numHosts)) {
+			return false;
+		}
+		options->customIntc = !Nan::Get(o, Nan::New("sysevtToChannel").ToLocalChecked()).ToLocalChecked()->IsUndefined() ||
+			!Nan::Get(o, Nan::New("hostEnableMask").ToLocalChecked()).ToLocalChecked()->IsUndefined();
+		
+		Local<Value> simulateOption = Nan::Get(o, Nan::New("simulate").ToLocalChecked()).ToLocalChecked();
+		if (!simulateOption->IsUndefined()) {
+			options->simulate = simulateOption->BooleanValue() ? 1 : 0;
+		}
+	} else if (!value->IsUndefined()) {
+		Nan::ThrowTypeError("Argument must be an array of host interrupts or an options object");
+		return false;
+	}
+	
+	if (options->numHosts == 0) {
+		options->hosts[options->numHosts++] = PRU_EVTOUT_0;
+	}
+	return true;
+}
+
 /* Initialise the PRU
  *	Initialise the PRU driver and static memory
- *	Takes no arguments and returns nothing
+ *	Opens the host interrupt PRU_EVTOUT_0 by default, or every host interrupt in the given list.
+ *	An options object can also replace the compiled-in INTC mapping, see parseIntcOptions,
+ *	and select the simulated PRUSS with simulate: true, for running without a BeagleBone.
+ *	init() is the default context of the thread: while a Pru context is open, it shares
+ *	the driver with it, see Pru::New.
+ *
+ *	@param {number[]|object} [hosts] host interrupts to open, e.g. [0, 1], or options
  */
 NAN_METHOD(InitPRU) {
+	Nan::HandleScope scope;
+	AddonEnv* env = currentEnv();
+	SessionOptions options;
+	std::string error;
 	
-	//Initialise driver
-	prussdrv_init ();
+	if (info.Length() > 1) {
+		return Nan::ThrowTypeError("Wrong number of arguments");
+	}
 	
-	//Open interrupt
-	unsigned int ret = prussdrv_open(PRU_EVTOUT_0);
-	if (ret) {
-		return Nan::ThrowError("Could not open PRU driver. Did you forget to load device tree fragment?");
-			
+	if (!parseInitOptions(info.Length() == 1 ? info[0] : Local<Value>(Nan::Undefined()), &options)) {
+		return;
 	}
 	
-	//Initialise interrupt
-	tpruss_intc_initdata pruss_intc_initdata = PRUSS_INTC_INITDATA;	
-	prussdrv_pruintc_init(&pruss_intc_initdata);
+	//Initialising again starts over, unless contexts keep the driver open
+	if (env->initialised) {
+		env->initialised = false;
+		closeSession(env);
+	}
 	
-	// Allocate shared PRU memory
-    	prussdrv_map_prumem(PRUSS0_SHARED_DATARAM, (void **) &sharedMem_int);
+	if (!openSession(env, options, &error)) {
+		return Nan::ThrowError(error.c_str());
+	}
+	env->initialised = true;
+}
 
-	prussdrv_map_prumem(PRUSS0_PRU0_DATARAM, (void **) &dataMem_pru0_int);
-	prussdrv_map_prumem(PRUSS0_PRU1_DATARAM, (void **) &dataMem_pru1_int);	
+/* Whether init() selected the simulated PRUSS
+ *
+ */
+NAN_METHOD(isSimulated) {
+	info.GetReturnValue().Set(Nan::New<Boolean>(prussdrv_is_simulated() != 0));
 }
 
 /* Loads PRU data file
@@ -118,28 +333,32 @@ NAN_METHOD(loadDatafile) {
 	//Get PRU num from arguments
 	pruNum = info[0]->Int32Value();
 	
-	//Load the datafile
-	int rc = prussdrv_load_datafile (pruNum, (char*)datafileS.c_str());
-	if (rc != 0) {
+	//Load the datafile, through the image cache
+	FirmwareImage image;
+	std::string error;
+	if (!loadImageFile(datafileS, DATARAM_SIZE, &image, &error) || loadDataImage(pruNum, image) != 0) {
 		return Nan::ThrowTypeError("failed to load datafile");
 	}
 }
 
 /* Execute PRU program
  *	Takes the filename of the .bin
+ *	Images are cached by path and mtime, and a restart of the resident image skips the IRAM write.
  *	
  *	@param {number} PRU number
  *	@param {string} filename
  *	@param {number} address
+ *	@param {boolean} [verify] read IRAM back first, when something outside this module may have written it
  */
 NAN_METHOD(executeProgram) {	
 	Nan::HandleScope scope;
 
 	size_t address = 0;
+	bool verify = false;
 	int pruNum = 0;
 
-	//Check we have three arguments
-	if (info.Length() != 3) {
+	//Check we have three or four arguments
+	if (info.Length() != 3 && info.Length() != 4) {
 		return Nan::ThrowError("Wrong number of arguments");
 	}
 
@@ -147,6 +366,10 @@ NAN_METHOD(executeProgram) {
 		address = info[2]->Uint32Value();
 	}
 
+	if (info.Length() == 4) {
+		verify = info[3]->BooleanValue();
+	}
+
 	//Get PRU number
 	pruNum = info[0]->Int32Value();
 
@@ -159,9 +382,10 @@ NAN_METHOD(executeProgram) {
 	String::Utf8Value program(info[1]->ToString());
 	std::string programS = std::string(*program);
 	
-	//Execute the program
-	int rc = prussdrv_exec_program_at (pruNum, (char*)programS.c_str(), address);
-	if (rc != 0) {
+	//Execute the program, only rewriting IRAM where it differs from the resident image
+	FirmwareImage image;
+	std::string error;
+	if (!loadImageFile(programS, IRAM_SIZE, &image, &error) || executeImage(pruNum, image, address, verify) != 0) {
 		return Nan::ThrowError("failed to execute PRU firmware");
 	}
 };
@@ -183,8 +407,13 @@ NAN_METHOD(setSharedRAMOffset) {
 		return Nan::ThrowTypeError("Argument must be Integer");
 	}
 
-	// set offset
-	offset_sharedRam = (unsigned int)Array::Cast(*info[0])->NumberValue();
+	//Check it leaves the offset inside shared RAM
+	if (info[0]->NumberValue() < 0 || info[0]->NumberValue() * 4 > SHAREDRAM_SIZE) {
+		return Nan::ThrowRangeError("Offset must be within shared RAM (0 to 3072 words)");
+	}
+
+	// set offset, of the context or of the module
+	*Pru::SharedRAMOffset(info) = (unsigned int)Array::Cast(*info[0])->NumberValue();
 };
 
 /* Get current shared PRU RAM offset
@@ -192,18 +421,19 @@ NAN_METHOD(setSharedRAMOffset) {
  */
 NAN_METHOD(getSharedRAMOffset) {
 	Nan::HandleScope scope;
-	info.GetReturnValue().Set(Nan::New<v8::Number>(offset_sharedRam));
+	info.GetReturnValue().Set(Nan::New<v8::Number>(*Pru::SharedRAMOffset(info)));
 };
 
 /* Set the shared PRU RAM to an input array
  *	Takes an integer array as input, writes it to PRU shared memory
- *	Not much error checking here, don't pass in large arrays or seg faults will happen
- *	TODO: error checking and allow user to select range to set
- *  New: also accepts an index + Buffer object as arguments
+ *	Writes that would run past the end of shared RAM throw a RangeError
+ *	TODO: allow user to select range to set
+ *  New: also accepts a byte index + Buffer object as arguments
  *  TODO: check if this usage of Buffers causes memory leaks
  */
 NAN_METHOD(setSharedRAM) {
 	Nan::HandleScope scope;
+	unsigned int offset_sharedRam = *Pru::SharedRAMOffset(info);
 	unsigned int i;
 	
 	//Check we have a single argument
@@ -220,6 +450,11 @@ NAN_METHOD(setSharedRAM) {
 		//Get array
 		Local<Array> a = Local<Array>::Cast(info[0]);
 		
+		if (!inRegion(REGION_SHAREDRAM, (uint64_t) offset_sharedRam * 4, (uint64_t) a->Length() * 4)) {
+			return Nan::ThrowRangeError("Array does not fit in shared RAM");
+		}
+		unsigned int* sharedMem_int = (unsigned int*) memRegions[REGION_SHAREDRAM].base;
+		
 		//Iterate over array
 		for (i = 0; i < a->Length(); i++) {
 			//Get element and check it's numeric
@@ -238,22 +473,31 @@ NAN_METHOD(setSharedRAM) {
 		Local<Object> buf = info[1]->ToObject();
 		char* data = node::Buffer::Data(buf);
 		size_t data_length = node::Buffer::Length(buf);
-		for (i = 0; i < data_length; i++) {
-			((char*) (sharedMem_int + offset_sharedRam))[index + i] = data[i];
+		uint64_t start = (uint64_t) offset_sharedRam * 4 + index;
+		if (!inRegion(REGION_SHAREDRAM, start, data_length)) {
+			return Nan::ThrowRangeError("Buffer does not fit in shared RAM");
 		}
+		pruss_copy_to_device(memRegions[REGION_SHAREDRAM].base + start, data, data_length);
 	}
 };
 
 
 /* Get array from shared memory
  *	Returns first 16 integers from shared memory (legacy default)
- *  New: Accepts start index and length as parameters and returns an actual Node Buffer
+ *  New: Accepts start index (in words) and length (in bytes) as parameters and returns an actual Node Buffer
+ *  Both forms start at the shared RAM offset
  *  TODO: check if this usage of Buffers causes memory leaks
  */
 NAN_METHOD(getSharedRAM) {
 	Nan::HandleScope scope;
+	unsigned int offset_sharedRam = *Pru::SharedRAMOffset(info);
 	
 	if (info.Length() < 1) { // for legacy compatibility
+		if (!inRegion(REGION_SHAREDRAM, (uint64_t) offset_sharedRam * 4, 16 * 4)) {
+			return Nan::ThrowRangeError("Shared RAM offset leaves less than 16 integers");
+		}
+		unsigned int* sharedMem_int = (unsigned int*) memRegions[REGION_SHAREDRAM].base;
+		
 		//Create output array
 		Local<Array> a = Nan::New<Array>(16);
 		
@@ -275,11 +519,17 @@ NAN_METHOD(getSharedRAM) {
 		}
 		
 		//Get the numbers
-		unsigned int index = (unsigned short)Array::Cast(*info[0])->NumberValue();
-		unsigned int length = (unsigned int)Array::Cast(*info[1])->NumberValue();
+		unsigned int index = info[0]->Uint32Value();
+		unsigned int length = info[1]->Uint32Value();
 		
-		Nan::MaybeLocal<v8::Object> buf = Nan::CopyBuffer(reinterpret_cast<const char*>(sharedMem_int + index), length);	
-		info.GetReturnValue().Set(buf.ToLocalChecked());
+		uint64_t start = ((uint64_t) offset_sharedRam + index) * 4;
+		if (!inRegion(REGION_SHAREDRAM, start, length)) {
+			return Nan::ThrowRangeError("Index and length must be within shared RAM");
+		}
+		
+		Local<Object> buf = Nan::NewBuffer(length).ToLocalChecked();
+		pruss_copy_from_device(node::Buffer::Data(buf), memRegions[REGION_SHAREDRAM].base + start, length);
+		info.GetReturnValue().Set(buf);
 	}
 };
 
@@ -292,61 +542,62 @@ NAN_METHOD(getSharedRAM) {
  *  the PRU num stays optional and defaults to 0.
  */
 Local<Value> getOrSetXFromOrToY(char mode, char what, char where, Nan::NAN_METHOD_ARGS_TYPE args) {	//array
-	Nan::HandleScope scope;
-	int pruNum = 0;
-	unsigned int val = 0;
+	Nan::EscapableHandleScope scope;
 	const char maxArgs = (mode == M_GET)? 2 : 3;
+	const unsigned int width = (what == X_INT)? 4 : 1;
 		
 	//Check we have at least one argument
 	if (args.Length() < 1 || args.Length() > maxArgs) {
 		Nan::ThrowTypeError("Wrong number of arguments");
-		return Nan::Null();
+		return scope.Escape(Nan::Null());
 	}
 	
 	//Check if arguments are numbers
 	if 	(!args[0]->IsNumber() || (args.Length() > 1 && !args[1]->IsNumber()) || (args.Length() > 2 && !args[2]->IsNumber())) {
 		Nan::ThrowTypeError("Argument must be Integer");
-		return Nan::Null();
+		return scope.Escape(Nan::Null());
 	}
 	
-	if (mode == M_SET) {
-		if (what == X_INT) {
-			val = (where == Y_DATAMEM && args.Length() > 2)? (unsigned int)Array::Cast(*args[2])->NumberValue() : (unsigned int)Array::Cast(*args[1])->NumberValue();
-		} else {
-			val = (where == Y_DATAMEM && args.Length() > 2)? (unsigned char)Array::Cast(*args[2])->NumberValue() : (unsigned char)Array::Cast(*args[1])->NumberValue();
-		}
-	}
-	
-	//Get index value
-	unsigned short index;
-	if (where == Y_DATAMEM && args.Length() > 1) {
-		index = (unsigned short)Array::Cast(*args[1])->NumberValue();
-		pruNum = args[0]->Int32Value();
-	} else {
-		index = (unsigned short)Array::Cast(*args[0])->NumberValue();
+	//The PRU num is only present when all arguments are given
+	const int first = (where == Y_DATAMEM && args.Length() == maxArgs)? 1 : 0;
+	if (mode == M_SET && args.Length() < first + 2) {
+		Nan::ThrowTypeError("Wrong number of arguments");
+		return scope.Escape(Nan::Null());
 	}
 	
-	unsigned int* addr;
+	//Find the region and where the index counts from
+	unsigned int region;
+	uint64_t start = 0;
 	if (where == Y_DATAMEM) {
-		if (pruNum == 0) {
-			addr = dataMem_pru0_int;
-		} else {
-			addr = dataMem_pru1_int;
+		int pruNum = first? args[0]->Int32Value() : 0;
+		if (pruNum != 0 && pruNum != 1) {
+			Nan::ThrowRangeError("PRU number must be 0 or 1");
+			return scope.Escape(Nan::Null());
 		}
+		region = REGION_DATARAM0 + pruNum;
 	} else {
-		addr = sharedMem_int + offset_sharedRam;
+		region = REGION_SHAREDRAM;
+		start = (uint64_t) *Pru::SharedRAMOffset(args) * 4;
+	}
+	
+	//Get index value and check it against the region
+	uint64_t offset = start + (uint64_t) args[first]->Uint32Value() * width;
+	if (!inRegion(region, offset, width)) {
+		Nan::ThrowRangeError("Index out of range");
+		return scope.Escape(Nan::Null());
 	}
+	char* addr = memRegions[region].base + offset;
 	
 	if (what == X_INT) {
 		if (mode == M_SET) {
-			addr[index] = val;
+			*(volatile unsigned int*) addr = args[first + 1]->Uint32Value();
 		}
-		return Nan::New<v8::Number>(addr[index]);
+		return scope.Escape(Nan::New<v8::Number>(*(volatile unsigned int*) addr));
 	} else {
 		if (mode == M_SET) {
-			((unsigned char*) addr)[index] = val;
+			*(volatile unsigned char*) addr = (unsigned char) args[first + 1]->Uint32Value();
 		}
-		return Nan::New<v8::Number>(((unsigned char*) addr)[index]);
+		return scope.Escape(Nan::New<v8::Number>(*(volatile unsigned char*) addr));
 	}
 };
 
@@ -387,14 +638,98 @@ NAN_METHOD(setDataRAMByte) {
 struct Baton {
     uv_work_t request;
     Nan::Persistent<Function> callback;
+    unsigned int host;
+    int timeout;
+    int cancel_fd;
+    bool cancelled;	//under waitsLock, a cancelled wait no longer enters the driver
+    uint32_t id;
     int error_code;
     std::string error_message;
     int32_t result;
+    uint64_t queued;
+    uint64_t started;
+    uint64_t woke;
 };
 
+// Waits queued or blocked on the threadpool, of every loop, under waitsLock
+static std::vector<Baton*> pendingWaits;
+static uint32_t nextWaitId = 1;
+static uv_mutex_t waitsLock;
+static uv_once_t waitsOnce = UV_ONCE_INIT;
+
+// Waits inside prussdrv_pru_wait_event_timeout(), under waitsLock, signalled when it drops to 0
+static unsigned int activeWaits = 0;
+static uv_cond_t waitsDone;
+
+static void initWaitsLock() {
+	uv_mutex_init(&waitsLock);
+	uv_cond_init(&waitsDone);
+}
+
+//With waitsLock held
+static void cancelPendingWait(Baton* baton) {
+	uint64_t one = 1;
+	baton->cancelled = true;
+	if (write(baton->cancel_fd, &one, sizeof(one)) < 0) {
+		//The counter can't overflow from a handful of cancels, nothing to do
+	}
+}
+
+/* Cancel outstanding waitForInterrupt() calls, so no threadpool thread stays blocked
+ *	on a host interrupt that is about to be closed
+ *	Writing the eventfd is all it takes, so waits of other loops can be cancelled too.
+ */
+void cancelPendingWaits(uv_loop_t* loop) {
+	uv_once(&waitsOnce, initWaitsLock);
+	uv_mutex_lock(&waitsLock);
+	for (size_t i = 0; i < pendingWaits.size(); i++) {
+		if (loop == NULL || pendingWaits[i]->request.loop == loop) {
+			cancelPendingWait(pendingWaits[i]);
+		}
+	}
+	uv_mutex_unlock(&waitsLock);
+}
+
+/* Block until no wait is left inside the driver
+ *	After cancelPendingWaits(NULL) the blocked ones return promptly, and the queued ones
+ *	see they were cancelled and never start, so prussdrv_exit() can't close an fd
+ *	under a read().
+ */
+void drainPendingWaits() {
+	uv_once(&waitsOnce, initWaitsLock);
+	uv_mutex_lock(&waitsLock);
+	while (activeWaits > 0) {
+		uv_cond_wait(&waitsDone, &waitsLock);
+	}
+	uv_mutex_unlock(&waitsLock);
+}
+
 void AsyncWork(uv_work_t* req) {
-//    Baton* baton = static_cast<Baton*>(req->data);
-	prussdrv_pru_wait_event(PRU_EVTOUT_0);
+    Baton* baton = static_cast<Baton*>(req->data);
+	unsigned int count = 0;
+	baton->started = statsNow();
+	
+	uv_mutex_lock(&waitsLock);
+	if (baton->cancelled) {
+		uv_mutex_unlock(&waitsLock);
+		baton->error_code = ECANCELED;
+		baton->result = 0;
+		baton->woke = statsNow();
+		return;
+	}
+	activeWaits++;
+	uv_mutex_unlock(&waitsLock);
+	
+	baton->error_code = prussdrv_pru_wait_event_timeout(baton->host, &count, baton->timeout, baton->cancel_fd) != 0 ? errno : 0;
+	
+	uv_mutex_lock(&waitsLock);
+	if (--activeWaits == 0) {
+		uv_cond_broadcast(&waitsDone);
+	}
+	uv_mutex_unlock(&waitsLock);
+	
+	baton->result = count;
+	baton->woke = statsNow();
 }
 
 // fix for "warning: invalid conversion from void (*)(uv_work_t*) {aka void (*)(uv_work_s*)} to uv_after_work_cb {aka void (*)(uv_work_s*, int)}"
@@ -406,67 +741,250 @@ void AsyncWork(uv_work_t* req) {
 #endif
     Nan::HandleScope scope;
     Baton* baton = static_cast<Baton*>(req->data);
-    Local<Function> cb = Nan::New<Function>(baton->callback);
-    cb->Call(Nan::GetCurrentContext()->Global(), 0, 0);
+	Nan::AsyncResource resource("pru:waitForInterrupt");
+	Nan::Callback callback(Nan::New<Function>(baton->callback));
+	Local<Value> argv[] = { Nan::Null(), Nan::New<Number>((uint32_t) baton->result) };
+	if (baton->error_code != 0) {
+		const char* message = baton->error_code == ETIMEDOUT ? "Timed out waiting for host interrupt" :
+			baton->error_code == ECANCELED ? "Wait for host interrupt cancelled" : strerror(baton->error_code);
+		argv[0] = Nan::Error(message);
+		Nan::Set(argv[0].As<Object>(), Nan::New("code").ToLocalChecked(),
+			Nan::New(uv_err_name(-baton->error_code)).ToLocalChecked());
+	}
+	uint64_t dispatched = statsNow();
+	statsRecord(STAGE_QUEUE, baton->queued, baton->started);
+	if (baton->error_code == 0) {
+		statsInterrupt(baton->host, baton->result, 1, baton->woke);
+	}
+	statsRecord(STAGE_DISPATCH, baton->woke, dispatched);
+	
+	//Freed before calling out, so a throwing callback can't leak it
+	int argc = baton->error_code != 0 ? 1 : 2;
+	uv_mutex_lock(&waitsLock);
+	pendingWaits.erase(std::find(pendingWaits.begin(), pendingWaits.end(), baton));
+	uv_mutex_unlock(&waitsLock);
+	close(baton->cancel_fd);
     baton->callback.Reset();
     delete baton;
+	callback.Call(argc, argv, &resource);
+	statsRecord(STAGE_CALLBACK, dispatched, statsNow());
 }
 
+/* Cancel handle returned by waitForInterrupt()
+ *	The wait is looked up by id, so cancelling after it completed does nothing
+ */
+NAN_METHOD(cancelWait) {
+	Nan::HandleScope scope;
+	uint32_t id = info.Data()->Uint32Value();
+	bool found = false;
+	
+	uv_mutex_lock(&waitsLock);
+	for (size_t i = 0; i < pendingWaits.size(); i++) {
+		if (pendingWaits[i]->id == id) {
+			cancelPendingWait(pendingWaits[i]);
+			found = true;
+			break;
+		}
+	}
+	uv_mutex_unlock(&waitsLock);
+	info.GetReturnValue().Set(Nan::New<Boolean>(found));
+}
+
+/* Wait for a single host interrupt on the threadpool
+ *	Each host interrupt is waited on by its own work item, so lines don't queue behind each other.
+ *	With a timeout the callback gets an error with code ETIMEDOUT once it expires, and
+ *	cancel() on the returned handle fails the wait with code ECANCELED, in both cases
+ *	the threadpool thread is released right away.
+ *
+ *	@param {number} [host] host interrupt, defaults to PRU_EVTOUT_0
+ *	@param {object} [options] { timeout: ms }
+ *	@param {function} callback(err, count)
+ *	@returns {object} { cancel() }, cancel() returns false if the wait already completed
+ */
 NAN_METHOD(waitForInterrupt) {
 	Nan::HandleScope scope;
-	Local<Function> callback = Local<Function>::Cast(info[0]);
+	unsigned int host = PRU_EVTOUT_0;
+	int timeout = -1;
+	int argc = info.Length();
+	
+	if (argc < 1 || argc > 3) {
+		return Nan::ThrowTypeError("Wrong number of arguments");
+	}
+	
+	if (argc > 1 && info[argc - 2]->IsObject()) {
+		Local<Object> options = info[argc - 2]->ToObject();
+		Local<Value> value = Nan::Get(options, Nan::New("timeout").ToLocalChecked()).ToLocalChecked();
+		if (!value->IsUndefined()) {
+			if (!value->IsNumber() || value->NumberValue() < 0 || value->NumberValue() > INT_MAX) {
+				return Nan::ThrowTypeError("Timeout must be a number of milliseconds");
+			}
+			timeout = value->Int32Value();
+		}
+		argc--;
+	}
+	
+	if (argc == 2) {
+		if (!info[0]->IsNumber()) {
+			return Nan::ThrowTypeError("Host interrupt must be Integer");
+		}
+		host = info[0]->Uint32Value();
+	} else if (argc != 1) {
+		return Nan::ThrowTypeError("Wrong number of arguments");
+	}
+	
+	if (!info[info.Length() - 1]->IsFunction()) {
+		return Nan::ThrowTypeError("Callback must be a function");
+	}
+	
+	if (host >= NUM_PRU_HOSTIRQS || prussdrv_pru_event_fd(host) <= 0) {
+		return Nan::ThrowError("Host interrupt is not open");
+	}
+	
+	int cancel_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (cancel_fd < 0) {
+		return Nan::ThrowError(strerror(errno));
+	}
+	
+	Local<Function> callback = Local<Function>::Cast(info[info.Length() - 1]);
 
 	Baton* baton = new Baton();
         baton->request.data = baton;
         baton->callback.Reset(callback);	
-	uv_queue_work(uv_default_loop(), &baton->request, AsyncWork, AsyncAfter);
+        baton->host = host;
+	baton->timeout = timeout;
+	baton->cancel_fd = cancel_fd;
+	baton->cancelled = false;
+	baton->queued = statsNow();
+	
+	//Queued under the lock, so a cancel from another thread finds the loop of the request
+	uv_once(&waitsOnce, initWaitsLock);
+	uv_mutex_lock(&waitsLock);
+	baton->id = nextWaitId++;
+	pendingWaits.push_back(baton);
+	uv_queue_work(Nan::GetCurrentEventLoop(), &baton->request, AsyncWork, AsyncAfter);
+	uv_mutex_unlock(&waitsLock);
+	
+	Local<Object> handle = Nan::New<Object>();
+	Nan::Set(handle, Nan::New("cancel").ToLocalChecked(),
+		Nan::GetFunction(Nan::New<FunctionTemplate>(cancelWait, Nan::New<Number>(baton->id))).ToLocalChecked());
+	info.GetReturnValue().Set(handle);
 }
 
 /*---------------------------Here ends the copy/pasting----------------------------*/
 
-/* Clear Interrupt */
+/* Clear Interrupt
+ *	Clears the system event and re-enables its host interrupt. Without a host interrupt
+ *	argument, the host the event is mapped to in the INTC is used.
+ *
+ *	@param {number} system event
+ *	@param {number} [host] host interrupt
+ */
 NAN_METHOD(clearInterrupt) {
 	Nan::HandleScope scope;
 	
-	//Check we have single argument
-	if (info.Length() != 1) {
+	//Check we have one or two arguments
+	if (info.Length() < 1 || info.Length() > 2) {
 		return Nan::ThrowTypeError("Wrong number of arguments");
 	}
 	
-	//Check it's a number
-	if (!info[0]->IsNumber()) {
+	//Check they are numbers
+	if (!info[0]->IsNumber() || (info.Length() > 1 && !info[1]->IsNumber())) {
 		return Nan::ThrowTypeError("Argument must be Integer");
 	}
 	
 	//Get index value
 	int event = (int) Array::Cast(*info[0])->NumberValue();
+	if (event < 0 || event >= NUM_PRU_SYS_EVTS) {
+		return Nan::ThrowRangeError("System event out of range");
+	}
 	
-	prussdrv_pru_clear_event(PRU0_ARM_INTERRUPT, event);
+	int host;
+	if (info.Length() > 1) {
+		host = info[1]->Int32Value();
+	} else {
+		host = prussdrv_get_event_to_host_map(event);
+		if (host < 0) {
+			host = PRU_EVTOUT_0;
+		}
+	}
+	
+	if (host < 0 || host >= NUM_PRU_HOSTIRQS) {
+		return Nan::ThrowRangeError("Host interrupt out of range");
+	}
+	
+	prussdrv_pru_clear_event(host, event);
 };
 
+/* Send a system event to the PRUs
+ *
+ *	@param {number} [event] system event, defaults to ARM_PRU0_INTERRUPT
+ */
 NAN_METHOD(interruptPRU) {
 	Nan::HandleScope scope;
-	prussdrv_pru_send_event(ARM_PRU0_INTERRUPT);
+	unsigned int event = ARM_PRU0_INTERRUPT;
+	
+	if (info.Length() > 0) {
+		if (!info[0]->IsNumber()) {
+			return Nan::ThrowTypeError("Argument must be Integer");
+		}
+		
+		event = info[0]->Uint32Value();
+		if (event >= NUM_PRU_SYS_EVTS) {
+			return Nan::ThrowRangeError("System event out of range");
+		}
+	}
+	
+	prussdrv_pru_send_event(event);
 };
 
 
-/* Force the PRU code to terminate */
+/* Force the PRU code to terminate
+ *	Releases the driver taken by init(). It stays open while Pru contexts, of this thread
+ *	or another, hold it, otherwise it is closed along with the thread's subscriptions.
+ */
 NAN_METHOD(forceExit) {
 	Nan::HandleScope scope;
+	AddonEnv* env = currentEnv();
 	if (info.Length() != 1) {
 		return Nan::ThrowTypeError("Wrong number of arguments");
 	}
 
 	prussdrv_pru_disable(info[0]->Uint32Value()); 
-    	prussdrv_exit();
+	if (env->initialised) {
+		env->initialised = false;
+		closeSession(env);
+	} else if (env->refs == 0) {
+		releaseThread(env);
+	}
 };
 
 /* Initialise the module */
 NAN_MODULE_INIT(Init) {
+	createEnv();
+	Ring::Init();
+	BlockReader::Init();
+	AccessPlan::Init();
+	
+	//	Memory regions
+	Nan::Set(target, Nan::New("DATARAM0").ToLocalChecked(), Nan::New<Number>(REGION_DATARAM0));
+	Nan::Set(target, Nan::New("DATARAM1").ToLocalChecked(), Nan::New<Number>(REGION_DATARAM1));
+	Nan::Set(target, Nan::New("SHAREDRAM").ToLocalChecked(), Nan::New<Number>(REGION_SHAREDRAM));
+	Nan::Set(target, Nan::New("EXTRAM").ToLocalChecked(), Nan::New<Number>(REGION_EXTRAM));
+	
+	//	System events the host sends to the PRUs
+	Nan::Set(target, Nan::New("ARM_PRU0_INTERRUPT").ToLocalChecked(), Nan::New<Number>(ARM_PRU0_INTERRUPT));
+	Nan::Set(target, Nan::New("ARM_PRU1_INTERRUPT").ToLocalChecked(), Nan::New<Number>(ARM_PRU1_INTERRUPT));
+	
 	//	pru.init();
+	// or: pru.init([0, 1]); // opens PRU_EVTOUT_0 and PRU_EVTOUT_1
+	// or: pru.init({ sysevtToChannel: [[19, 2], [24, 4]], channelToHost: [[2, 2], [4, 4]] });
+	// or: pru.init({ simulate: true }); // no hardware needed, as does PRUSS_SIMULATOR=1
 	Nan::Set(target, Nan::New("init").ToLocalChecked(),
 		Nan::GetFunction(Nan::New<FunctionTemplate>(InitPRU)).ToLocalChecked());
 
+	//	if (pru.isSimulated()) ...
+	Nan::SetMethod(target, "isSimulated", isSimulated);
+	
 	//	pru.loadDatafile(0, "data.bin");
 	Nan::Set(target, Nan::New("loadDatafile").ToLocalChecked(),
 		Nan::GetFunction(Nan::New<FunctionTemplate>(loadDatafile)).ToLocalChecked());
@@ -475,6 +993,14 @@ NAN_MODULE_INIT(Init) {
 	Nan::Set(target, Nan::New("execute").ToLocalChecked(),
 		Nan::GetFunction(Nan::New<FunctionTemplate>(executeProgram)).ToLocalChecked());
 	
+	//	pru.loadDatafileAsync(0, "data.bin").then(...);
+	Nan::SetMethod(target, "loadDatafileAsync", loadDatafileAsync);
+	
+	//	pru.executeAsync(0, "mycode.bin", 0x40).then(...);
+	//	pru.executeAsync(0, firmwareBuffer);
+	//	pru.executeAsync(0, "mycode.bin", 0, true); // read IRAM back before trusting what is resident
+	Nan::SetMethod(target, "executeAsync", executeAsync);
+	
 	//	var intVal = pru.getSharedRAMOffset();
 	Nan::Set(target, Nan::New("getSharedRAMOffset").ToLocalChecked(),
 		Nan::GetFunction(Nan::New<FunctionTemplate>(getSharedRAMOffset)).ToLocalChecked());
@@ -492,6 +1018,56 @@ NAN_MODULE_INIT(Init) {
 	Nan::Set(target, Nan::New("setSharedRAM").ToLocalChecked(),
 		Nan::GetFunction(Nan::New<FunctionTemplate>(setSharedRAM)).ToLocalChecked());
 	
+	//	var mem = pru.mapSharedRAM(); // Buffer aliasing all 12KB of shared RAM
+	// or: var words = pru.mapSharedRAM("uint32"); // Uint32Array over the same memory
+	Nan::Set(target, Nan::New("mapSharedRAM").ToLocalChecked(),
+		Nan::GetFunction(Nan::New<FunctionTemplate>(mapSharedRAM)).ToLocalChecked());
+	
+	//	var mem = pru.mapDataRAM(0); // Buffer aliasing the 8KB data RAM of PRU0
+	// or: var words = pru.mapDataRAM(1, "uint32");
+	Nan::Set(target, Nan::New("mapDataRAM").ToLocalChecked(),
+		Nan::GetFunction(Nan::New<FunctionTemplate>(mapDataRAM)).ToLocalChecked());
+	
+	//	var ddr = pru.mapExtRAM(); // Buffer aliasing the DDR pool of uio_pruss, 256KB by default
+	Nan::Set(target, Nan::New("mapExtRAM").ToLocalChecked(),
+		Nan::GetFunction(Nan::New<FunctionTemplate>(mapExtRAM)).ToLocalChecked());
+	
+	//	pru.writeUInt32(pru.DATARAM0, 0, pru.getPhysAddr(pru.EXTRAM)); // tell the firmware where DDR is
+	Nan::Set(target, Nan::New("getPhysAddr").ToLocalChecked(),
+		Nan::GetFunction(Nan::New<FunctionTemplate>(getPhysAddr)).ToLocalChecked());
+	
+	//	var val = pru.readUInt32(pru.SHAREDRAM, 0x100); // byte offset from the start of the region
+	Nan::SetMethod(target, "readUInt8", readUInt8);
+	Nan::SetMethod(target, "readUInt16", readUInt16);
+	Nan::SetMethod(target, "readUInt32", readUInt32);
+	Nan::SetMethod(target, "readInt32", readInt32);
+	Nan::SetMethod(target, "readFloat", readFloat);
+	Nan::SetMethod(target, "readUInt64", readUInt64);
+	Nan::SetMethod(target, "readInt64", readInt64);
+	
+	//	pru.writeUInt32(pru.DATARAM0, 0x10, 0xa1b2c3d4);
+	Nan::SetMethod(target, "writeUInt8", writeUInt8);
+	Nan::SetMethod(target, "writeUInt16", writeUInt16);
+	Nan::SetMethod(target, "writeUInt32", writeUInt32);
+	Nan::SetMethod(target, "writeInt32", writeInt32);
+	Nan::SetMethod(target, "writeFloat", writeFloat);
+	
+	//	var buf = pru.readv([{ region: pru.DATARAM0, offset: 0, length: 16 }, { region: pru.SHAREDRAM, offset: 64, length: 8 }]);
+	Nan::SetMethod(target, "readv", readv);
+	
+	//	pru.writev([{ region: pru.SHAREDRAM, offset: 0, length: 4 }], Buffer.from([1, 2, 3, 4]));
+	Nan::SetMethod(target, "writev", writev);
+	
+	//	var plan = pru.createPlan([{ region: pru.DATARAM0, offset: 0, length: 16 }]);
+	//	var buf = plan.read(); // same Buffer on every call
+	Nan::SetMethod(target, "createPlan", createPlan);
+	
+	//	pru.enableStats(true);
+	Nan::SetMethod(target, "enableStats", enableStats);
+	
+	//	var s = pru.stats(); // s.dispatch.p99, s.hosts[0].missed, ...
+	Nan::SetMethod(target, "stats", stats);
+	
 	//	var intVal = pru.getSharedRAMInt(3);
 	Nan::Set(target, Nan::New("getSharedRAMInt").ToLocalChecked(),
 		Nan::GetFunction(Nan::New<FunctionTemplate>(getSharedRAMInt)).ToLocalChecked());
@@ -529,20 +1105,88 @@ NAN_MODULE_INIT(Init) {
 		Nan::GetFunction(Nan::New<FunctionTemplate>(setDataRAMByte)).ToLocalChecked());
 	
 	//	pru.waitForInterrupt(function() { console.log("Interrupted by PRU");});
+	// or: pru.waitForInterrupt(1, function() { console.log("Interrupted on PRU_EVTOUT_1");});
+	// or: var wait = pru.waitForInterrupt(1, { timeout: 50 }, function(err, count) { ... }); wait.cancel();
 	Nan::Set(target, Nan::New("waitForInterrupt").ToLocalChecked(),
 		Nan::GetFunction(Nan::New<FunctionTemplate>(waitForInterrupt)).ToLocalChecked());
 
-	//	pru.clearInterrupt();
+	//	pru.onInterrupt(0, function(err, count, missed) { pru.clearInterrupt(19); });
+	// or: pru.onInterrupt(0, { autoClear: 19 }, callback); // cleared natively, see also nextInterrupt() in index.js
+	// or: pru.onInterrupt(0, { priority: 80, cpu: 1, mlock: true }, callback); // dedicated SCHED_FIFO thread
+	// or: pru.onInterrupt(0, { priority: 80, notify: 1000, actions: [
+	//		{ op: 'capture', region: pru.SHAREDRAM, offset: 0, length: 64 },
+	//		{ op: 'clearEvent', event: 19 }, { op: 'sendEvent', event: 21 } ] },
+	//		function(err, count, missed, captured, dropped) { ... });
+	// or: pru.onInterrupt(0, { plugin: './handler.so' }, callback); // see src/pru_handler.h
+	// or: pru.onInterrupt(0, { batch: { events: 256, interval: 2000, snapshot: { region: pru.SHAREDRAM, offset: 0, length: 16 } } },
+	//		function(err, count, missed, records) { ... }); // 16 byte header + snapshot per record
+	Nan::Set(target, Nan::New("onInterrupt").ToLocalChecked(),
+		Nan::GetFunction(Nan::New<FunctionTemplate>(onInterrupt)).ToLocalChecked());
+	
+	//	pru.offInterrupt(0);
+	Nan::Set(target, Nan::New("offInterrupt").ToLocalChecked(),
+		Nan::GetFunction(Nan::New<FunctionTemplate>(offInterrupt)).ToLocalChecked());
+	
+	//	pru.attachEventFd(1, fs.openSync('/tmp/evtout1', 'r+')); // tests: read counts from a FIFO, see test/
+	Nan::SetMethod(target, "attachEventFd", attachEventFd);
+
+	//	pru.clearInterrupt(19);
+	// or: pru.clearInterrupt(20, 1); // second arg is the host interrupt
 	Nan::Set(target, Nan::New("clearInterrupt").ToLocalChecked(),
 		Nan::GetFunction(Nan::New<FunctionTemplate>(clearInterrupt)).ToLocalChecked());
 	
 	//	pru.interrupt();
+	// or: pru.interrupt(22); // ARM_PRU1_INTERRUPT
 	Nan::Set(target, Nan::New("interrupt").ToLocalChecked(),
 		Nan::GetFunction(Nan::New<FunctionTemplate>(interruptPRU)).ToLocalChecked());
 	
+	//	var status = pru.snapshot(pru.SHAREDRAM, 0x200, 24); // record under the seq word at 0x200, see firmware/pru_seqlock.h
+	Nan::SetMethod(target, "snapshot", snapshot);
+	
+	//	var w = pru.watch(pru.DATARAM0, 0x100, 64, function(changes) { ... }, { interval: 500 });
+	// or: pru.watch([{ region: pru.DATARAM0, offset: 0, length: 16 }, { region: pru.SHAREDRAM, offset: 0, length: 8 }], cb);
+	//	w.close();
+	Nan::SetMethod(target, "watch", watch);
+	
+	//	var ring = pru.createRing({ region: pru.SHAREDRAM, offset: 0x100, capacity: 64, elementSize: 8 });
+	//	var batch = ring.read(16); // Buffer with up to 16 elements
+	//	var written = ring.write(commands, pru.ARM_PRU0_INTERRUPT); // interrupts the PRU only if it had emptied the ring
+	Nan::Set(target, Nan::New("createRing").ToLocalChecked(),
+		Nan::GetFunction(Nan::New<FunctionTemplate>(createRing)).ToLocalChecked());
+	
+	//	var reader = pru.createBlockReader({ region: pru.DATARAM0, offset: 0x100, blocks: 2, blockSize: 65536 });
+	//	var index = reader.next(); ...; reader.release(); // see firmware/pru_stream.h
+	Nan::Set(target, Nan::New("createBlockReader").ToLocalChecked(),
+		Nan::GetFunction(Nan::New<FunctionTemplate>(createBlockReader)).ToLocalChecked());
+	
+	//	pru.halt(0); var state = pru.getState(0); // state.pc, state.registers
+	//	pru.step(0, 10); pru.resume(0); // or pru.resume(0, 0x40) to restart at an address
+	//	pru.reset(0); // halted at address 0, program and data RAM kept
+	Nan::SetMethod(target, "halt", halt);
+	Nan::SetMethod(target, "resume", resume);
+	Nan::SetMethod(target, "step", step);
+	Nan::SetMethod(target, "reset", resetPRU);
+	Nan::SetMethod(target, "getState", getState);
+	
+	//	pru.startProfiler({ pru: 0, interval: 50 }); // sample PRU0 every 50us
+	//	var p = pru.profile()[0]; // p.hot[0].address, p.cyclesPerSecond, p.utilization
+	Nan::SetMethod(target, "startProfiler", startProfiler);
+	Nan::SetMethod(target, "stopProfiler", stopProfiler);
+	Nan::SetMethod(target, "profile", profile);
+	
 	//	pru.exit();
 	Nan::Set(target, Nan::New("exit").ToLocalChecked(),
 		Nan::GetFunction(Nan::New<FunctionTemplate>(forceExit)).ToLocalChecked());
+	
+	//	var a = new pru.Pru({ hosts: [0], sharedRAMOffset: 0 }); // own driver reference and offset
+	//	a.setSharedRAMInt(0, 1); a.onInterrupt(0, callback); ...; a.close();
+	// or: new pru.Pru() in a worker thread, init() and contexts share the one PRUSS
+	Pru::Init(target);
 }
 
+// Loaded once per thread, each Node.js worker gets its own module instance
+#if defined(NAN_MODULE_WORKER_ENABLED)
+NAN_MODULE_WORKER_ENABLED(prussdrv, Init)
+#else
 NODE_MODULE(prussdrv, Init)
+#endif
@@ -0,0 +1,218 @@
+//PRU Driver headers
+#include <prussdrv.h>
+
+//Node.js addon headers
+#include <node_buffer.h>
+#include <nan.h>
+
+#include "memory.h"
+#include "ring.h"
+#include "context.h"
+
+using namespace v8;
+
+void Ring::Init() {
+	Local<FunctionTemplate> tpl = Nan::New<FunctionTemplate>(New);
+	tpl->SetClassName(Nan::New("Ring").ToLocalChecked());
+	tpl->InstanceTemplate()->SetInternalFieldCount(1);
+	
+	Nan::SetPrototypeMethod(tpl, "read", Read);
+	Nan::SetPrototypeMethod(tpl, "available", Available);
+	Nan::SetPrototypeMethod(tpl, "write", Write);
+	Nan::SetPrototypeMethod(tpl, "space", Space);
+	
+	currentEnv()->ringConstructor.Reset(Nan::GetFunction(tpl).ToLocalChecked());
+}
+
+NAN_METHOD(Ring::New) {
+	Ring* obj = new Ring();
+	obj->Wrap(info.This());
+	info.GetReturnValue().Set(info.This());
+}
+
+Local<Object> Ring::NewInstance(const RingBuffer& ring, unsigned int generation) {
+	Nan::EscapableHandleScope scope;
+	
+	Local<Object> instance = Nan::NewInstance(Nan::New(currentEnv()->ringConstructor)).ToLocalChecked();
+	Ring* obj = Nan::ObjectWrap::Unwrap<Ring>(instance);
+	obj->ring = ring;
+	obj->generation = generation;
+	
+	Nan::Set(instance, Nan::New("capacity").ToLocalChecked(), Nan::New<Number>(obj->ring.capacity()));
+	Nan::Set(instance, Nan::New("elementSize").ToLocalChecked(), Nan::New<Number>(obj->ring.elementSize()));
+	return scope.Escape(instance);
+}
+
+Ring* Ring::Check(Nan::NAN_METHOD_ARGS_TYPE info) {
+	Ring* obj = Nan::ObjectWrap::Unwrap<Ring>(info.Holder());
+	if (obj->generation != mappingGeneration) {
+		Nan::ThrowError("PRU memory was unmapped, the ring is no longer valid");
+		return NULL;
+	}
+	return obj;
+}
+
+/* Read a batch of elements
+ *	Returns a Buffer holding up to maxItems elements back to back, empty if there are none
+ *
+ *	@param {number} maxItems
+ */
+NAN_METHOD(Ring::Read) {
+	Nan::HandleScope scope;
+	
+	if (info.Length() != 1) {
+		return Nan::ThrowTypeError("Wrong number of arguments");
+	}
+	
+	if (!info[0]->IsNumber()) {
+		return Nan::ThrowTypeError("Argument must be Integer");
+	}
+	
+	Ring* obj = Check(info);
+	if (obj == NULL) {
+		return;
+	}
+	
+	uint32_t maxItems = info[0]->Uint32Value();
+	uint32_t available = obj->ring.available();
+	if (available > obj->ring.capacity()) {
+		return Nan::ThrowError("Ring head is corrupt");
+	}
+	if (maxItems > available) {
+		maxItems = available;
+	}
+	
+	Local<Object> buf = Nan::NewBuffer(maxItems * obj->ring.elementSize()).ToLocalChecked();
+	uint32_t count = obj->ring.read(node::Buffer::Data(buf), maxItems);
+	
+	//The producer can only have added elements in the meantime, so count == maxItems
+	info.GetReturnValue().Set(count == maxItems ? buf : Nan::CopyBuffer(node::Buffer::Data(buf), count * obj->ring.elementSize()).ToLocalChecked());
+}
+
+/* Number of elements waiting to be read */
+NAN_METHOD(Ring::Available) {
+	Nan::HandleScope scope;
+	
+	Ring* obj = Check(info);
+	if (obj == NULL) {
+		return;
+	}
+	
+	info.GetReturnValue().Set(Nan::New<Number>(obj->ring.available()));
+}
+
+/* Write a batch of elements, for rings the PRU consumes
+ *	Copies as many whole elements as there are free slots, in one go, and publishes them
+ *	together. With an event, the PRU is only interrupted if it had emptied the ring, so a
+ *	stream of commands doesn't interrupt it once per command. The firmware has to look at
+ *	the ring again after clearing the event, before it waits for the next one.
+ *
+ *	@param {Buffer} data, a whole number of elements back to back
+ *	@param {number} [event] system event to send when the ring was empty, e.g. ARM_PRU0_INTERRUPT
+ *	@returns {number} elements written, less than given when the ring is full
+ */
+NAN_METHOD(Ring::Write) {
+	Nan::HandleScope scope;
+	bool wasEmpty;
+	
+	if (info.Length() < 1 || info.Length() > 2) {
+		return Nan::ThrowTypeError("Wrong number of arguments");
+	}
+	
+	if (!node::Buffer::HasInstance(info[0])) {
+		return Nan::ThrowTypeError("Data must be a Buffer");
+	}
+	
+	if (info.Length() > 1 && (!info[1]->IsNumber() || info[1]->Uint32Value() >= NUM_PRU_SYS_EVTS)) {
+		return Nan::ThrowRangeError("System event out of range");
+	}
+	
+	Ring* obj = Check(info);
+	if (obj == NULL) {
+		return;
+	}
+	
+	size_t length = node::Buffer::Length(info[0]);
+	if (length % obj->ring.elementSize() != 0) {
+		return Nan::ThrowRangeError("Data must be a whole number of elements");
+	}
+	
+	uint32_t count = obj->ring.write(node::Buffer::Data(info[0]), length / obj->ring.elementSize(), &wasEmpty);
+	if (wasEmpty && info.Length() > 1) {
+		prussdrv_pru_send_event(info[1]->Uint32Value());
+	}
+	
+	info.GetReturnValue().Set(Nan::New<Number>(count));
+}
+
+/* Number of free slots for write() */
+NAN_METHOD(Ring::Space) {
+	Nan::HandleScope scope;
+	
+	Ring* obj = Check(info);
+	if (obj == NULL) {
+		return;
+	}
+	
+	info.GetReturnValue().Set(Nan::New<Number>(obj->ring.space()));
+}
+
+/* Open a ring buffer in PRU memory
+ *	With capacity and elementSize a new empty ring is written at offset,
+ *	without them the header the firmware wrote there is validated and used.
+ *
+ *	@param {object} options { region, offset, capacity, elementSize }
+ */
+NAN_METHOD(createRing) {
+	Nan::HandleScope scope;
+	char* base;
+	size_t size;
+	RingBuffer ring;
+	
+	if (info.Length() != 1 || !info[0]->IsObject()) {
+		return Nan::ThrowTypeError("Argument must be an options object");
+	}
+	
+	Local<Object> options = info[0]->ToObject();
+	Local<Value> region = Nan::Get(options, Nan::New("region").ToLocalChecked()).ToLocalChecked();
+	Local<Value> offset = Nan::Get(options, Nan::New("offset").ToLocalChecked()).ToLocalChecked();
+	Local<Value> capacity = Nan::Get(options, Nan::New("capacity").ToLocalChecked()).ToLocalChecked();
+	Local<Value> elementSize = Nan::Get(options, Nan::New("elementSize").ToLocalChecked()).ToLocalChecked();
+	
+	if (!region->IsNumber() || !getRegion(region->Uint32Value(), &base, &size)) {
+		return Nan::ThrowError("region must be a mapped memory region, did you call init()?");
+	}
+	unsigned int regionI = region->Uint32Value();
+	
+	uint32_t offsetI = offset->IsUndefined() ? 0 : offset->Uint32Value();
+	if (!(offset->IsUndefined() || offset->IsNumber()) || (offsetI & 3) != 0 || !inRegion(regionI, offsetI, PRU_RING_HEADER_SIZE)) {
+		return Nan::ThrowRangeError("offset must be 4 byte aligned and inside the region");
+	}
+	
+	if (!capacity->IsUndefined() || !elementSize->IsUndefined()) {
+		if (!capacity->IsNumber() || !elementSize->IsNumber()) {
+			return Nan::ThrowTypeError("capacity and elementSize must be given together");
+		}
+		
+		uint32_t capacityI = capacity->Uint32Value();
+		uint32_t elementSizeI = elementSize->Uint32Value();
+		if (capacityI == 0 || (capacityI & (capacityI - 1)) != 0) {
+			return Nan::ThrowRangeError("capacity must be a power of two");
+		}
+		if (elementSizeI == 0 || (elementSizeI & 3) != 0) {
+			return Nan::ThrowRangeError("elementSize must be a multiple of 4");
+		}
+		if (!inRegion(regionI, offsetI, RingBuffer::footprint(capacityI, elementSizeI))) {
+			return Nan::ThrowRangeError("Ring does not fit in the region");
+		}
+		
+		RingBuffer::format(base + offsetI, capacityI, elementSizeI);
+	}
+	
+	//The PRU may rewrite the header at any time, what gets used is what attach() checked
+	if (!ring.attach(base + offsetI, size - offsetI)) {
+		return Nan::ThrowError("No valid ring header at offset");
+	}
+	
+	info.GetReturnValue().Set(Ring::NewInstance(ring, mappingGeneration));
+}
@@ -0,0 +1,32 @@
+#ifndef _RING_H
+#define _RING_H
+
+#include <nan.h>
+
+#include "ringbuffer.h"
+
+/* JS handle on a ring buffer in PRU memory, see firmware/pru_ring.h */
+class Ring : public Nan::ObjectWrap {
+public:
+	static void Init();
+	
+	//Create a handle, returns an empty handle with a pending exception on failure
+	static v8::Local<v8::Object> NewInstance(const RingBuffer& ring, unsigned int generation);
+	
+private:
+	static NAN_METHOD(New);
+	static NAN_METHOD(Read);
+	static NAN_METHOD(Available);
+	static NAN_METHOD(Write);
+	static NAN_METHOD(Space);
+	
+	//Unwrap this and check the mapping is still the one the ring was created on
+	static Ring* Check(Nan::NAN_METHOD_ARGS_TYPE info);
+	
+	RingBuffer ring;
+	unsigned int generation;
+};
+
+NAN_METHOD(createRing);
+
+#endif
@@ -0,0 +1,120 @@
+#include <pruss_copy.h>
+
+#include "ringbuffer.h"
+
+/* The ring header is written by the PRU behind the compiler's back, so head is loaded
+ * with acquire semantics before the elements are read, and tail is stored with release
+ * semantics after they have been copied. On ARMv7 both emit a dmb.
+ */
+static inline uint32_t loadAcquire(volatile uint32_t* p) {
+	return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static inline void storeRelease(volatile uint32_t* p, uint32_t v) {
+	__atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+void RingBuffer::format(void* mem, uint32_t capacity, uint32_t elemSize) {
+	struct pru_ring* r = (struct pru_ring*) mem;
+	
+	r->capacity = capacity;
+	r->elem_size = elemSize;
+	r->tail = 0;
+	storeRelease(&r->head, 0);
+}
+
+uint64_t RingBuffer::footprint(uint32_t capacity, uint32_t elemSize) {
+	return PRU_RING_HEADER_SIZE + (uint64_t) capacity * elemSize;
+}
+
+bool RingBuffer::attach(void* mem, size_t size) {
+	struct pru_ring* r = (struct pru_ring*) mem;
+	uint32_t capacity = r->capacity;
+	uint32_t elementSize = r->elem_size;
+	
+	if (capacity == 0 || (capacity & (capacity - 1)) != 0) {
+		return false;
+	}
+	if (elementSize == 0 || (elementSize & 3) != 0) {
+		return false;
+	}
+	if (footprint(capacity, elementSize) > size) {
+		return false;
+	}
+	
+	ring = r;
+	slots = capacity;
+	elemSize = elementSize;
+	return true;
+}
+
+uint32_t RingBuffer::available() const {
+	uint32_t count = loadAcquire(&ring->head) - ring->tail;
+	return count > slots ? slots + 1 : count;
+}
+
+uint32_t RingBuffer::read(void* dst, uint32_t maxItems) {
+	uint32_t capacity = slots;
+	uint32_t tail = ring->tail;
+	uint32_t count = loadAcquire(&ring->head) - tail;
+	
+	//A head more than capacity ahead can only come from a confused producer
+	if (count > capacity) {
+		return 0;
+	}
+	if (count > maxItems) {
+		count = maxItems;
+	}
+	if (count == 0) {
+		return 0;
+	}
+	
+	//Copy in at most two runs, up to the end of the data area and from its start
+	const char* data = (const char*) ring + PRU_RING_DATA;
+	uint32_t slot = tail & (capacity - 1);
+	uint32_t first = capacity - slot < count ? capacity - slot : count;
+	pruss_copy_from_device(dst, data + (size_t) slot * elemSize, (size_t) first * elemSize);
+	pruss_copy_from_device((char*) dst + (size_t) first * elemSize, data, (size_t) (count - first) * elemSize);
+	
+	storeRelease(&ring->tail, tail + count);
+	return count;
+}
+
+uint32_t RingBuffer::space() const {
+	uint32_t count = ring->head - loadAcquire(&ring->tail);
+	return count > slots ? 0 : slots - count;
+}
+
+uint32_t RingBuffer::write(const void* src, uint32_t maxItems, bool* wasEmpty) {
+	uint32_t capacity = slots;
+	uint32_t head = ring->head;
+	uint32_t count = space();
+	
+	*wasEmpty = false;
+	if (count > maxItems) {
+		count = maxItems;
+	}
+	if (count == 0) {
+		return 0;
+	}
+	
+	//Copy in at most two runs, as in read()
+	char* data = (char*) ring + PRU_RING_DATA;
+	uint32_t slot = head & (capacity - 1);
+	uint32_t first = capacity - slot < count ? capacity - slot : count;
+	pruss_copy_to_device(data + (size_t) slot * elemSize, src, (size_t) first * elemSize);
+	pruss_copy_to_device(data, (const char*) src + (size_t) first * elemSize, (size_t) (count - first) * elemSize);
+	
+	storeRelease(&ring->head, head + count);
+	
+	//Release only orders earlier accesses, the tail load could still pass the head store
+	//and see a consumer that went idle without seeing this batch. The full fence keeps
+	//them in order on the CPU, and reading head back drains the posted write to the PRU.
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	(void) loadAcquire(&ring->head);
+	
+	//Checked after publishing, so a consumer that went idle in between is still woken up.
+	//If it took elements of this batch already, it is running and needs no wake-up.
+	*wasEmpty = loadAcquire(&ring->tail) == head;
+	return count;
+}
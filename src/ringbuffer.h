@@ -0,0 +1,55 @@
+#ifndef _RINGBUFFER_H
+#define _RINGBUFFER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <pru_ring.h>
+
+/* Host side of the ring buffer described in firmware/pru_ring.h
+ *	The host is the consumer of rings the PRU fills and the producer of rings it drains.
+ *	Works on any memory holding a ring header, which makes it usable against
+ *	a plain anonymous mmap as well as the PRU mappings.
+ */
+class RingBuffer {
+public:
+	RingBuffer() : ring(NULL), slots(0), elemSize(0) {}
+	
+	//Write a fresh header for an empty ring at mem
+	static void format(void* mem, uint32_t capacity, uint32_t elemSize);
+	
+	//Bytes needed for the header plus capacity elements
+	static uint64_t footprint(uint32_t capacity, uint32_t elemSize);
+	
+	//Use the ring at mem, if its header describes a valid ring that fits in size bytes
+	//capacity and elem_size are checked and copied once, later changes to the header are ignored
+	bool attach(void* mem, size_t size);
+	
+	uint32_t capacity() const { return slots; }
+	uint32_t elementSize() const { return elemSize; }
+	
+	//Number of elements ready to be read, or capacity + 1 if the producer corrupted head
+	uint32_t available() const;
+	
+	//Copy up to maxItems elements to dst and release their slots
+	//Returns the number of elements copied
+	uint32_t read(void* dst, uint32_t maxItems);
+	
+	//Number of free slots, 0 if the consumer corrupted tail
+	uint32_t space() const;
+	
+	//Producer side, for rings the host feeds: copy up to maxItems elements from src and publish them
+	//Returns the number of elements written, *wasEmpty tells whether the consumer had
+	//already taken everything written before, and so may be waiting to be woken up
+	uint32_t write(const void* src, uint32_t maxItems, bool* wasEmpty);
+	
+private:
+	struct pru_ring* ring;
+	
+	//The header is writable by the PRU and by JS, so the geometry checked at attach()
+	//is the only one used, a changed header can't make a copy overrun its buffer
+	uint32_t slots;
+	uint32_t elemSize;
+};
+
+#endif
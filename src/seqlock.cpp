@@ -0,0 +1,107 @@
+//System headers
+#include <sched.h>
+
+//PRU Driver headers
+#include <pruss_copy.h>
+
+//Node.js addon headers
+#include <node_buffer.h>
+#include <nan.h>
+
+#include "memory.h"
+#include "seqlock.h"
+
+using namespace v8;
+
+//Retries of snapshot() by default, each costs one copy of the record
+#define SEQLOCK_RETRIES		1000
+
+//Retries after which the reader yields the CPU, in case the writer shares it
+#define SEQLOCK_YIELD_AFTER	64
+
+/* The fences order the copy between the two loads of seq, which the uncached
+ * mapping alone doesn't guarantee on ARMv7. Both emit a dmb there.
+ */
+bool seqlockRead(const volatile void* lock, void* dst, size_t length, uint32_t maxRetries) {
+	const volatile uint32_t* seq = (const volatile uint32_t*) lock;
+	const volatile char* data = (const volatile char*) lock + PRU_SEQLOCK_DATA;
+	
+	//64 bit, so maxRetries 0xFFFFFFFF still ends
+	for (uint64_t i = 0; i <= maxRetries; i++) {
+		uint32_t before = __atomic_load_n(seq, __ATOMIC_ACQUIRE);
+		if ((before & 1) == 0) {
+			pruss_copy_from_device(dst, data, length);
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+			if (*seq == before) {
+				return true;
+			}
+		}
+		if (i >= SEQLOCK_YIELD_AFTER) {
+			sched_yield();
+		}
+	}
+	return false;
+}
+
+/* Copy a record the PRU updates under a sequence lock, see firmware/pru_seqlock.h
+ *	The seq word is at offset and the record of length bytes follows it. The copy is
+ *	retried while the PRU is writing, which costs far less than halting it or an
+ *	interrupt handshake per read.
+ *
+ *	@param {number} region, one of DATARAM0, DATARAM1, SHAREDRAM, EXTRAM
+ *	@param {number} offset of the seq word, 4 byte aligned
+ *	@param {number} length of the record in bytes
+ *	@param {Buffer|object} [out] Buffer to fill instead of allocating one, or { out, retries }
+ */
+NAN_METHOD(snapshot) {
+	Nan::HandleScope scope;
+	uint32_t retries = SEQLOCK_RETRIES;
+	Local<Value> outValue = Nan::Undefined();
+	
+	if (info.Length() < 3 || info.Length() > 4) {
+		return Nan::ThrowTypeError("Wrong number of arguments");
+	}
+	
+	if (!info[0]->IsNumber() || !info[1]->IsNumber() || !info[2]->IsNumber()) {
+		return Nan::ThrowTypeError("Region, offset and length must be Integer");
+	}
+	
+	uint32_t region = info[0]->Uint32Value();
+	uint32_t offset = info[1]->Uint32Value();
+	uint32_t length = info[2]->Uint32Value();
+	if ((offset & 3) != 0 || !inRegion(region, offset, (uint64_t) PRU_SEQLOCK_HEADER_SIZE + length)) {
+		return Nan::ThrowRangeError("Offset out of range or misaligned for this region");
+	}
+	
+	if (info.Length() == 4) {
+		if (node::Buffer::HasInstance(info[3])) {
+			outValue = info[3];
+		} else if (info[3]->IsObject()) {
+			Local<Object> options = info[3]->ToObject();
+			Local<Value> retriesOption = Nan::Get(options, Nan::New("retries").ToLocalChecked()).ToLocalChecked();
+			outValue = Nan::Get(options, Nan::New("out").ToLocalChecked()).ToLocalChecked();
+			if (!retriesOption->IsUndefined()) {
+				if (!retriesOption->IsNumber()) {
+					return Nan::ThrowTypeError("retries must be Integer");
+				}
+				retries = retriesOption->Uint32Value();
+			}
+		} else {
+			return Nan::ThrowTypeError("Argument must be a Buffer or an options object");
+		}
+	}
+	
+	Local<Object> out;
+	if (outValue->IsUndefined()) {
+		out = Nan::NewBuffer(length).ToLocalChecked();
+	} else if (!node::Buffer::HasInstance(outValue) || node::Buffer::Length(outValue) < length) {
+		return Nan::ThrowRangeError("out must be a Buffer of at least length bytes");
+	} else {
+		out = outValue.As<Object>();
+	}
+	
+	if (!seqlockRead(memRegions[region].base + offset, node::Buffer::Data(out), length, retries)) {
+		return Nan::ThrowError("The PRU kept updating the record, no consistent snapshot");
+	}
+	info.GetReturnValue().Set(out);
+}
@@ -0,0 +1,17 @@
+#ifndef _SEQLOCK_H
+#define _SEQLOCK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <nan.h>
+
+#include <pru_seqlock.h>
+
+//Copy the record of the sequence lock at lock to dst, retrying up to maxRetries times
+//Returns false if the PRU was writing it on every try
+bool seqlockRead(const volatile void* lock, void* dst, size_t length, uint32_t maxRetries);
+
+NAN_METHOD(snapshot);
+
+#endif
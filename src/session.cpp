@@ -0,0 +1,120 @@
+//System headers
+#include <string.h>
+
+//PRU Driver headers
+#include <prussdrv.h>
+
+#include <uv.h>
+
+#include "memory.h"
+#include "imagecache.h"
+#include "interrupts.h"
+#include "profiler.h"
+#include "watch.h"
+#include "session.h"
+
+/* The driver is process-wide: one PRUSS, one mapping, one set of UIO fds
+ *	Contexts in any thread share it through references, under sessionLock, so two
+ *	workers can't open or close it at the same time.
+ */
+static uv_mutex_t sessionLock;
+static uv_once_t sessionOnce = UV_ONCE_INIT;
+static unsigned int refs = 0;
+static tpruss_intc_initdata activeIntc;
+
+static void initSessionLock() {
+	uv_mutex_init(&sessionLock);
+}
+
+/* Open the host interrupts that are not open yet */
+static bool openHosts(const SessionOptions& options, std::string* error) {
+	for (unsigned int i = 0; i < options.numHosts; i++) {
+		if (prussdrv_pru_event_fd(options.hosts[i]) > 0) {
+			continue;
+		}
+		
+		if (prussdrv_open(options.hosts[i]) != 0) {
+			*error = "Could not open PRU driver. Did you forget to load device tree fragment?";
+			return false;
+		}
+	}
+	return true;
+}
+
+/* Close the driver, with sessionLock held
+ *	Whatever still runs off the loop threads is stopped first: blocked waits, the
+ *	watch thread and the profiler would otherwise touch fds and memory going away.
+ */
+static void closeDriver() {
+	cancelPendingWaits(NULL);
+	drainPendingWaits();
+	stopWatches();
+	stopProfiling();
+	unmapRegions();
+	forgetResidentImages();
+	prussdrv_exit();
+}
+
+bool acquireSession(const SessionOptions& options, std::string* error) {
+	uv_once(&sessionOnce, initSessionLock);
+	uv_mutex_lock(&sessionLock);
+	
+	if (refs == 0) {
+		prussdrv_init();
+		if (options.simulate >= 0) {
+			prussdrv_simulate(options.simulate);
+		}
+		
+		if (!openHosts(options, error)) {
+			prussdrv_exit();
+			uv_mutex_unlock(&sessionLock);
+			return false;
+		}
+		
+		if (prussdrv_pruintc_init(&options.intc) != 0) {
+			*error = "Could not initialise the PRU interrupt controller";
+			prussdrv_exit();
+			uv_mutex_unlock(&sessionLock);
+			return false;
+		}
+		activeIntc = options.intc;
+		
+		//Map shared, data and external memory
+		mapRegions();
+		
+		//IRAM may have been loaded by someone else since we last saw it
+		forgetResidentImages();
+	} else {
+		//Reconfiguring the INTC or switching to the simulator would pull it from under the others
+		if (options.simulate >= 0 && (options.simulate != 0) != (prussdrv_is_simulated() != 0)) {
+			*error = prussdrv_is_simulated() ? "The driver is already open on the simulator" :
+				"The driver is already open on the hardware";
+			uv_mutex_unlock(&sessionLock);
+			return false;
+		}
+		
+		if (options.customIntc && memcmp(&options.intc, &activeIntc, sizeof(activeIntc)) != 0) {
+			*error = "The interrupt controller is already configured differently by another context";
+			uv_mutex_unlock(&sessionLock);
+			return false;
+		}
+		
+		if (!openHosts(options, error)) {
+			uv_mutex_unlock(&sessionLock);
+			return false;
+		}
+	}
+	
+	refs++;
+	uv_mutex_unlock(&sessionLock);
+	return true;
+}
+
+void releaseSession() {
+	uv_once(&sessionOnce, initSessionLock);
+	uv_mutex_lock(&sessionLock);
+	if (refs > 0 && --refs == 0) {
+		closeDriver();
+	}
+	uv_mutex_unlock(&sessionLock);
+}
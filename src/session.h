@@ -0,0 +1,29 @@
+#ifndef _SESSION_H
+#define _SESSION_H
+
+#include <string>
+
+//PRU Driver headers
+#include <prussdrv.h>
+
+/* How a context wants the driver opened
+ *	The first context to open the driver configures the INTC and picks hardware or
+ *	simulator, later ones must ask for the same or leave it at the default.
+ */
+struct SessionOptions {
+	tpruss_intc_initdata intc;
+	unsigned int hosts[NUM_PRU_HOSTIRQS];
+	unsigned int numHosts;
+	int simulate;	//-1: as set by PRUSS_SIMULATOR in the environment
+	bool customIntc;	//intc was given explicitly rather than PRUSS_INTC_INITDATA
+};
+
+//Take a reference on the driver, opening it and mapping the PRUSS for the first one.
+//Host interrupts not open yet are opened. Any thread, returns false and sets error on failure
+bool acquireSession(const SessionOptions& options, std::string* error);
+
+//Drop a reference, the last one closes the driver. Resources of the calling thread
+//must have been released first, see releaseThread() in context.h
+void releaseSession();
+
+#endif
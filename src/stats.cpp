@@ -0,0 +1,222 @@
+//System headers
+#include <string.h>
+#include <vector>
+
+//PRU Driver headers
+#include <prussdrv.h>
+
+//Node.js addon headers
+#include <uv.h>
+#include <nan.h>
+
+#include "stats.h"
+
+using namespace v8;
+
+bool statsEnabled = false;
+
+//The loops of all threads record into the same statistics
+static uv_mutex_t statsLock;
+static uv_once_t statsOnce = UV_ONCE_INIT;
+
+static LatencyHistogram histograms[NUM_STAGES];
+static const char* stageNames[NUM_STAGES] = { "queue", "dispatch", "callback", "interval" };
+
+struct HostStats {
+	uint64_t interrupts;
+	uint64_t missed;
+	uint32_t lastCount;
+	uint64_t lastWake;
+	bool primed;
+};
+
+static HostStats hostStats[NUM_PRU_HOSTIRQS];
+
+void LatencyHistogram::reset() {
+	memset(buckets, 0, sizeof(buckets));
+	total = 0;
+	sum = 0;
+	minimum = UINT64_MAX;
+	maximum = 0;
+}
+
+unsigned int LatencyHistogram::bucketOf(uint64_t ns) {
+	if (ns < 32) {
+		return ns;
+	}
+	
+	unsigned int shift = 63 - __builtin_clzll(ns) - 4;
+	unsigned int bucket = 32 + (shift - 1) * 16 + ((ns >> shift) - 16);
+	return bucket < BUCKETS ? bucket : BUCKETS - 1;
+}
+
+uint64_t LatencyHistogram::bucketMidpoint(unsigned int bucket) {
+	if (bucket < 32) {
+		return bucket;
+	}
+	
+	unsigned int shift = (bucket - 32) / 16 + 1;
+	uint64_t low = (uint64_t) ((bucket - 32) % 16 + 16) << shift;
+	return low + ((1ULL << shift) >> 1);
+}
+
+void LatencyHistogram::record(uint64_t ns) {
+	buckets[bucketOf(ns)]++;
+	total++;
+	sum += ns;
+	if (ns < minimum) {
+		minimum = ns;
+	}
+	if (ns > maximum) {
+		maximum = ns;
+	}
+}
+
+uint64_t LatencyHistogram::percentile(double q) const {
+	if (total == 0) {
+		return 0;
+	}
+	
+	uint64_t rank = (uint64_t) (q * total);
+	if (rank >= total) {
+		rank = total - 1;
+	}
+	
+	uint64_t seen = 0;
+	for (unsigned int i = 0; i < BUCKETS; i++) {
+		seen += buckets[i];
+		if (seen > rank) {
+			uint64_t value = bucketMidpoint(i);
+			return value < maximum ? value : maximum;
+		}
+	}
+	return maximum;
+}
+
+static void initStatsLock() {
+	uv_mutex_init(&statsLock);
+}
+
+static void lockStats() {
+	uv_once(&statsOnce, initStatsLock);
+	uv_mutex_lock(&statsLock);
+}
+
+//With statsLock held
+static void recordLocked(unsigned int stage, uint64_t start, uint64_t end) {
+	if (statsEnabled && start != 0 && end >= start) {
+		histograms[stage].record(end - start);
+	}
+}
+
+void statsRecord(unsigned int stage, uint64_t start, uint64_t end) {
+	if (start == 0) {
+		return;
+	}
+	
+	lockStats();
+	recordLocked(stage, start, end);
+	uv_mutex_unlock(&statsLock);
+}
+
+void statsInterrupt(unsigned int host, uint32_t count, uint32_t reads, uint64_t wake) {
+	if (wake == 0 || host >= NUM_PRU_HOSTIRQS) {
+		return;
+	}
+	
+	lockStats();
+	if (!statsEnabled) {
+		uv_mutex_unlock(&statsLock);
+		return;
+	}
+	
+	HostStats& h = hostStats[host];
+	if (h.primed) {
+		uint32_t gap = count - h.lastCount;
+		h.missed += gap > reads ? gap - reads : 0;
+		recordLocked(STAGE_INTERVAL, h.lastWake, wake);
+	}
+	h.interrupts += reads;
+	h.lastCount = count;
+	h.lastWake = wake;
+	h.primed = true;
+	uv_mutex_unlock(&statsLock);
+}
+
+//With statsLock held
+static void resetStats() {
+	for (unsigned int i = 0; i < NUM_STAGES; i++) {
+		histograms[i].reset();
+	}
+	memset(hostStats, 0, sizeof(hostStats));
+}
+
+/* Turn interrupt instrumentation on or off
+ *	Off by default, when nothing but a flag test is added to the interrupt path.
+ *	Turning it on starts from empty statistics.
+ *
+ *	@param {boolean} enable
+ */
+NAN_METHOD(enableStats) {
+	if (info.Length() != 1) {
+		return Nan::ThrowTypeError("Wrong number of arguments");
+	}
+	
+	bool enable = info[0]->BooleanValue();
+	lockStats();
+	if (enable && !statsEnabled) {
+		resetStats();
+	}
+	__atomic_store_n(&statsEnabled, enable, __ATOMIC_RELAXED);
+	uv_mutex_unlock(&statsLock);
+}
+
+/* Get the interrupt statistics
+ *	Latencies are in microseconds, per stage: { count, min, mean, p50, p90, p99, p999, max }.
+ *	hosts[n] counts the interrupts of PRU_EVTOUT_n that were read, including those coalesced
+ *	or handled natively, and those missed, from gaps in the UIO event count beyond them.
+ *
+ *	@param {boolean} [reset] start over after reading
+ */
+NAN_METHOD(stats) {
+	Nan::HandleScope scope;
+	Local<Object> result = Nan::New<Object>();
+	
+	//Copied out under the lock, the JS objects are built without holding up the other loops
+	lockStats();
+	bool enabled = statsEnabled;
+	std::vector<LatencyHistogram> stages(histograms, histograms + NUM_STAGES);
+	HostStats hostsCopy[NUM_PRU_HOSTIRQS];
+	memcpy(hostsCopy, hostStats, sizeof(hostStats));
+	if (info.Length() > 0 && info[0]->BooleanValue()) {
+		resetStats();
+	}
+	uv_mutex_unlock(&statsLock);
+	
+	Nan::Set(result, Nan::New("enabled").ToLocalChecked(), Nan::New<Boolean>(enabled));
+	
+	for (unsigned int i = 0; i < NUM_STAGES; i++) {
+		const LatencyHistogram& h = stages[i];
+		Local<Object> stage = Nan::New<Object>();
+		Nan::Set(stage, Nan::New("count").ToLocalChecked(), Nan::New<Number>(h.count()));
+		Nan::Set(stage, Nan::New("min").ToLocalChecked(), Nan::New<Number>(h.min() / 1e3));
+		Nan::Set(stage, Nan::New("mean").ToLocalChecked(), Nan::New<Number>(h.mean() / 1e3));
+		Nan::Set(stage, Nan::New("p50").ToLocalChecked(), Nan::New<Number>(h.percentile(0.5) / 1e3));
+		Nan::Set(stage, Nan::New("p90").ToLocalChecked(), Nan::New<Number>(h.percentile(0.9) / 1e3));
+		Nan::Set(stage, Nan::New("p99").ToLocalChecked(), Nan::New<Number>(h.percentile(0.99) / 1e3));
+		Nan::Set(stage, Nan::New("p999").ToLocalChecked(), Nan::New<Number>(h.percentile(0.999) / 1e3));
+		Nan::Set(stage, Nan::New("max").ToLocalChecked(), Nan::New<Number>(h.max() / 1e3));
+		Nan::Set(result, Nan::New(stageNames[i]).ToLocalChecked(), stage);
+	}
+	
+	Local<Array> hosts = Nan::New<Array>(NUM_PRU_HOSTIRQS);
+	for (unsigned int i = 0; i < NUM_PRU_HOSTIRQS; i++) {
+		Local<Object> host = Nan::New<Object>();
+		Nan::Set(host, Nan::New("interrupts").ToLocalChecked(), Nan::New<Number>(hostsCopy[i].interrupts));
+		Nan::Set(host, Nan::New("missed").ToLocalChecked(), Nan::New<Number>(hostsCopy[i].missed));
+		Nan::Set(hosts, i, host);
+	}
+	Nan::Set(result, Nan::New("hosts").ToLocalChecked(), hosts);
+	
+	info.GetReturnValue().Set(result);
+}
@@ -0,0 +1,66 @@
+#ifndef _STATS_H
+#define _STATS_H
+
+#include <stdint.h>
+
+#include <uv.h>
+#include <nan.h>
+
+/* Log-linear latency histogram, in the manner of HdrHistogram
+ *	Values below 32 ns are exact, larger ones fall in one of 16 buckets per power of
+ *	two, so any value is reported within about 6%. Recording is O(1) and allocation free.
+ */
+class LatencyHistogram {
+public:
+	LatencyHistogram() { reset(); }
+	
+	void reset();
+	void record(uint64_t ns);
+	
+	uint64_t count() const { return total; }
+	uint64_t min() const { return total ? minimum : 0; }
+	uint64_t max() const { return maximum; }
+	double mean() const { return total ? (double) sum / total : 0; }
+	
+	//Value at quantile q in [0, 1], the midpoint of its bucket
+	uint64_t percentile(double q) const;
+	
+private:
+	static const unsigned int BUCKETS = 32 + 40 * 16;
+	
+	static unsigned int bucketOf(uint64_t ns);
+	static uint64_t bucketMidpoint(unsigned int bucket);
+	
+	uint32_t buckets[BUCKETS];
+	uint64_t total;
+	uint64_t sum;
+	uint64_t minimum;
+	uint64_t maximum;
+};
+
+//Interrupt delivery stages, all measured on the event loop thread
+#define STAGE_QUEUE		0	//waitForInterrupt: uv_queue_work() to the threadpool starting the read
+#define STAGE_DISPATCH	1	//native wake-up, read() returning, to the JS callback being entered
+#define STAGE_CALLBACK	2	//time spent in the JS callback
+#define STAGE_INTERVAL	3	//time between two interrupts of the same host
+#define NUM_STAGES		4
+
+//Set by pru.enableStats(), every hook checks it before touching the clock
+//Hooks run on every loop and on interrupt and threadpool threads, so it is read atomically
+extern bool statsEnabled;
+
+//Clock used for all timestamps, in ns
+inline uint64_t statsNow() {
+	return __atomic_load_n(&statsEnabled, __ATOMIC_RELAXED) ? uv_hrtime() : 0;
+}
+
+void statsRecord(unsigned int stage, uint64_t start, uint64_t end);
+
+//Count a wake-up of a host interrupt with the UIO running count read from it, covering
+//reads events read since the last one, so gaps beyond them are counted as missed
+void statsInterrupt(unsigned int host, uint32_t count, uint32_t reads, uint64_t wake);
+
+NAN_METHOD(enableStats);
+NAN_METHOD(stats);
+
+#endif
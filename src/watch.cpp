@@ -0,0 +1,379 @@
+//System headers
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <vector>
+#include <algorithm>
+
+//PRU Driver headers
+#include <pruss_copy.h>
+
+//Node.js addon headers
+#include <uv.h>
+#include <nan.h>
+
+#include "memory.h"
+#include "batch.h"
+#include "watch.h"
+
+using namespace v8;
+
+//Default and shortest polling interval, in microseconds
+#define WATCH_INTERVAL		1000
+#define WATCH_MIN_INTERVAL	10
+
+/* Watched range with the last contents seen
+ *	dirty flags the words that changed since JS was last called, so a slow loop gets
+ *	one callback with the latest values instead of a backlog of passes
+ */
+struct WatchRange {
+	Segment segment;
+	const volatile char* mem;
+	std::vector<uint32_t> shadow;
+	std::vector<uint32_t> current;	//scratch copy of the memory, only used by the thread
+	std::vector<uint8_t> dirty;
+};
+
+/* One watch() call: some ranges, their interval and the JS callback
+ *	The ranges are diffed on the shared watch thread, which hands changes to the loop
+ *	through async. shadow and dirty are shared with it under lock.
+ */
+struct Watch {
+	uv_async_t async;
+	uint32_t id;
+	uint64_t interval;	//ns
+	uint64_t due;		//uv_hrtime() of the next pass
+	unsigned int generation;	//mapping the ranges point into
+	std::vector<WatchRange> ranges;
+	bool changed;
+	uv_mutex_t lock;
+	Nan::Callback callback;
+	Nan::AsyncResource resource;
+	
+	Watch() : resource("pru:watch") {}
+};
+
+//Watches the thread diffs, of every loop, under watchLock. The thread waits on watchCond between passes.
+static std::vector<Watch*> watches;
+static uv_mutex_t watchLock;
+static uv_cond_t watchCond;
+static pthread_t watchThread;
+static bool watchRunning = false;
+static bool watchStopping = false;
+static uint32_t nextWatchId = 1;
+static uv_once_t watchOnce = UV_ONCE_INIT;
+
+/* Diff one range against its shadow
+ *	The memory is copied out in one go, then compared 8 bytes at a time, so unchanged
+ *	stretches cost one compare per two words. Returns true if a word changed.
+ */
+static bool diffRange(WatchRange* range) {
+	size_t words = range->shadow.size();
+	uint32_t* current = &range->current[0];
+	uint32_t* shadow = &range->shadow[0];
+	bool changed = false;
+	size_t i = 0;
+	
+	pruss_copy_from_device(current, range->mem, words * 4);
+	
+	for (; i + 2 <= words; i += 2) {
+		uint64_t a, b;
+		memcpy(&a, current + i, 8);
+		memcpy(&b, shadow + i, 8);
+		if (a == b) {
+			continue;
+		}
+		for (size_t j = i; j < i + 2; j++) {
+			if (current[j] != shadow[j]) {
+				shadow[j] = current[j];
+				range->dirty[j] = 1;
+				changed = true;
+			}
+		}
+	}
+	if (i < words && current[i] != shadow[i]) {
+		shadow[i] = current[i];
+		range->dirty[i] = 1;
+		changed = true;
+	}
+	return changed;
+}
+
+static void* watchMain(void* arg) {
+	uv_mutex_lock(&watchLock);
+	while (!watchStopping) {
+		uint64_t now = uv_hrtime();
+		uint64_t next = UINT64_MAX;
+		
+		for (size_t i = 0; i < watches.size(); i++) {
+			Watch* w = watches[i];
+			
+			//Left behind by a thread when the driver was closed, until that thread closes it
+			if (w->generation != mappingGeneration) {
+				continue;
+			}
+			if (w->due <= now) {
+				bool changed = false;
+				uv_mutex_lock(&w->lock);
+				for (size_t j = 0; j < w->ranges.size(); j++) {
+					changed |= diffRange(&w->ranges[j]);
+				}
+				w->changed |= changed;
+				uv_mutex_unlock(&w->lock);
+				
+				//One callback per pass at most, with every range that changed in it
+				if (changed) {
+					uv_async_send(&w->async);
+				}
+				w->due = std::max(w->due + w->interval, now);
+			}
+			next = std::min(next, w->due);
+		}
+		
+		if (next == UINT64_MAX) {
+			uv_cond_wait(&watchCond, &watchLock);
+		} else {
+			now = uv_hrtime();
+			if (next > now) {
+				uv_cond_timedwait(&watchCond, &watchLock, next - now);
+			}
+		}
+	}
+	uv_mutex_unlock(&watchLock);
+	return NULL;
+}
+
+static void onWatchClosed(uv_handle_t* handle) {
+	Watch* w = static_cast<Watch*>(handle->data);
+	uv_mutex_destroy(&w->lock);
+	delete w;
+}
+
+/* Take the changed words of a watch, as runs of consecutive words */
+static void onWatchAsync(uv_async_t* handle) {
+	Nan::HandleScope scope;
+	Watch* w = static_cast<Watch*>(handle->data);
+	Local<Array> changes = Nan::New<Array>();
+	uint32_t n = 0;
+	
+	uv_mutex_lock(&w->lock);
+	if (!w->changed) {
+		uv_mutex_unlock(&w->lock);
+		return;
+	}
+	w->changed = false;
+	for (size_t i = 0; i < w->ranges.size(); i++) {
+		WatchRange& range = w->ranges[i];
+		size_t words = range.dirty.size();
+		for (size_t start = 0; start < words; start++) {
+			if (!range.dirty[start]) {
+				continue;
+			}
+			size_t end = start;
+			while (end < words && range.dirty[end]) {
+				range.dirty[end++] = 0;
+			}
+			
+			Local<Object> change = Nan::New<Object>();
+			Nan::Set(change, Nan::New("region").ToLocalChecked(), Nan::New<Number>(range.segment.region));
+			Nan::Set(change, Nan::New("offset").ToLocalChecked(), Nan::New<Number>(range.segment.offset + start * 4));
+			Nan::Set(change, Nan::New("data").ToLocalChecked(),
+				Nan::CopyBuffer((const char*) &range.shadow[start], (end - start) * 4).ToLocalChecked());
+			Nan::Set(changes, n++, change);
+			start = end;
+		}
+	}
+	uv_mutex_unlock(&w->lock);
+	
+	Local<Value> argv[] = { changes };
+	w->callback.Call(1, argv, &w->resource);
+}
+
+static void initWatchLock() {
+	uv_mutex_init(&watchLock);
+	uv_cond_init(&watchCond);
+}
+
+/* Remove a watch from the thread, it is deleted once its async handle has closed */
+static void closeWatch(Watch* w) {
+	uv_mutex_lock(&watchLock);
+	watches.erase(std::find(watches.begin(), watches.end(), w));
+	uv_mutex_unlock(&watchLock);
+	uv_close((uv_handle_t*) &w->async, onWatchClosed);
+}
+
+void closeWatches(uv_loop_t* loop) {
+	std::vector<Watch*> closing;
+	
+	uv_once(&watchOnce, initWatchLock);
+	uv_mutex_lock(&watchLock);
+	for (size_t i = 0; i < watches.size(); i++) {
+		if (watches[i]->async.loop == loop) {
+			closing.push_back(watches[i]);
+		}
+	}
+	uv_mutex_unlock(&watchLock);
+	
+	for (size_t i = 0; i < closing.size(); i++) {
+		closeWatch(closing[i]);
+	}
+}
+
+void stopWatches() {
+	uv_once(&watchOnce, initWatchLock);
+	uv_mutex_lock(&watchLock);
+	if (!watchRunning) {
+		uv_mutex_unlock(&watchLock);
+		return;
+	}
+	watchStopping = true;
+	uv_cond_signal(&watchCond);
+	uv_mutex_unlock(&watchLock);
+	
+	pthread_join(watchThread, NULL);
+	
+	uv_mutex_lock(&watchLock);
+	watchRunning = false;
+	watchStopping = false;
+	uv_mutex_unlock(&watchLock);
+}
+
+/* close() of the handle returned by watch(), the watch is looked up by id */
+static NAN_METHOD(unwatch) {
+	uint32_t id = info.Data()->Uint32Value();
+	Watch* w = NULL;
+	
+	uv_mutex_lock(&watchLock);
+	for (size_t i = 0; i < watches.size(); i++) {
+		if (watches[i]->id == id) {
+			w = watches[i];
+			break;
+		}
+	}
+	uv_mutex_unlock(&watchLock);
+	
+	if (w != NULL) {
+		closeWatch(w);
+	}
+	info.GetReturnValue().Set(Nan::New<Boolean>(w != NULL));
+}
+
+/* Watch PRU memory for changes
+ *	A native thread copies the ranges out every interval and diffs them against the
+ *	previous copy, JS is only called when words changed. All changes found in one pass
+ *	come in one callback, as runs of consecutive changed words with their new contents.
+ *	If the loop falls behind, changes coalesce and only the latest values are reported.
+ *	Offsets and lengths must be multiples of 4.
+ *
+ *	@param {number|object[]} region, or an array of {region, offset, length} to watch together
+ *	@param {number} offset byte offset in the region (not with an array)
+ *	@param {number} length in bytes (not with an array)
+ *	@param {function} callback([{ region, offset, data }, ...])
+ *	@param {object} [options] { interval: microseconds, 1000 by default, ref }
+ *	@returns {object} { close() }
+ */
+NAN_METHOD(watch) {
+	Nan::HandleScope scope;
+	std::vector<Segment> segments;
+	uint32_t totalLength;
+	int next;
+	
+	if (info.Length() > 0 && info[0]->IsArray()) {
+		if (!parseSegments(info[0], segments, &totalLength)) {
+			return;
+		}
+		next = 1;
+	} else {
+		if (info.Length() < 4 || !info[0]->IsNumber() || !info[1]->IsNumber() || !info[2]->IsNumber()) {
+			return Nan::ThrowTypeError("Region, offset and length must be Integer");
+		}
+		Segment segment = { info[0]->Uint32Value(), info[1]->Uint32Value(), info[2]->Uint32Value() };
+		if (!inRegion(segment.region, segment.offset, segment.length)) {
+			return Nan::ThrowRangeError("Range out of its region, or region not mapped");
+		}
+		segments.push_back(segment);
+		next = 3;
+	}
+	
+	if (info.Length() <= next || !info[next]->IsFunction()) {
+		return Nan::ThrowTypeError("Callback must be a function");
+	}
+	if (info.Length() > next + 2 || (info.Length() == next + 2 && !info[next + 1]->IsObject())) {
+		return Nan::ThrowTypeError("Options must be an object");
+	}
+	
+	if (segments.empty()) {
+		return Nan::ThrowRangeError("Nothing to watch");
+	}
+	for (size_t i = 0; i < segments.size(); i++) {
+		if ((segments[i].offset & 3) != 0 || (segments[i].length & 3) != 0 || segments[i].length == 0) {
+			return Nan::ThrowRangeError("Watched offsets and lengths must be multiples of 4");
+		}
+	}
+	
+	uint32_t interval = WATCH_INTERVAL;
+	bool ref = true;
+	if (info.Length() == next + 2) {
+		Local<Object> options = info[next + 1]->ToObject();
+		Local<Value> intervalOption = Nan::Get(options, Nan::New("interval").ToLocalChecked()).ToLocalChecked();
+		Local<Value> refOption = Nan::Get(options, Nan::New("ref").ToLocalChecked()).ToLocalChecked();
+		if (!intervalOption->IsUndefined()) {
+			if (!intervalOption->IsNumber() || intervalOption->NumberValue() < WATCH_MIN_INTERVAL) {
+				return Nan::ThrowRangeError("interval must be at least 10 microseconds");
+			}
+			interval = intervalOption->Uint32Value();
+		}
+		if (!refOption->IsUndefined()) {
+			ref = refOption->BooleanValue();
+		}
+	}
+	
+	uv_once(&watchOnce, initWatchLock);
+	
+	Watch* w = new Watch();
+	w->interval = (uint64_t) interval * 1000;
+	w->due = uv_hrtime() + w->interval;
+	w->generation = mappingGeneration;
+	w->changed = false;
+	w->callback.Reset(Local<Function>::Cast(info[next]));
+	w->ranges.resize(segments.size());
+	for (size_t i = 0; i < segments.size(); i++) {
+		WatchRange& range = w->ranges[i];
+		range.segment = segments[i];
+		range.mem = memRegions[segments[i].region].base + segments[i].offset;
+		range.shadow.resize(segments[i].length / 4);
+		range.current.resize(segments[i].length / 4);
+		range.dirty.assign(segments[i].length / 4, 0);
+		
+		//Changes are relative to the contents at the time of the call
+		pruss_copy_from_device(&range.shadow[0], range.mem, segments[i].length);
+	}
+	uv_mutex_init(&w->lock);
+	uv_async_init(Nan::GetCurrentEventLoop(), &w->async, onWatchAsync);
+	w->async.data = w;
+	if (!ref) {
+		uv_unref((uv_handle_t*) &w->async);
+	}
+	
+	//Loops of several workers may get here at once, only one starts the thread
+	int rc = 0;
+	uv_mutex_lock(&watchLock);
+	w->id = nextWatchId++;
+	watches.push_back(w);
+	uv_cond_signal(&watchCond);
+	if (!watchRunning) {
+		rc = pthread_create(&watchThread, NULL, watchMain, NULL);
+		watchRunning = rc == 0;
+	}
+	uv_mutex_unlock(&watchLock);
+	
+	if (rc != 0) {
+		closeWatch(w);
+		return Nan::ThrowError(strerror(rc));
+	}
+	
+	Local<Object> handle = Nan::New<Object>();
+	Nan::Set(handle, Nan::New("close").ToLocalChecked(),
+		Nan::GetFunction(Nan::New<FunctionTemplate>(unwatch, Nan::New<Number>(w->id))).ToLocalChecked());
+	info.GetReturnValue().Set(handle);
+}
@@ -0,0 +1,16 @@
+#ifndef _WATCH_H
+#define _WATCH_H
+
+#include <uv.h>
+#include <nan.h>
+
+NAN_METHOD(watch);
+
+//Close the watches made on a loop
+void closeWatches(uv_loop_t* loop);
+
+//Join the watch thread, must run before the PRUSS is unmapped. Watches of threads
+//that have not closed them yet stay idle, a later watch() starts the thread again
+void stopWatches();
+
+#endif
@@ -0,0 +1,176 @@
+/* RingBuffer against a plain anonymous mapping standing in for PRU memory
+ *	No PRU, driver or Node.js needed: npm run test-ring
+ *	The PRU side is played by writing the header words directly, as the firmware would.
+ */
+
+//System headers
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "ringbuffer.h"
+
+static int failures = 0;
+
+#define CHECK(condition) do { \
+	if (!(condition)) { \
+		fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #condition); \
+		failures++; \
+	} \
+} while (0)
+
+#define MAPPING_SIZE	4096
+
+static char* mapMemory() {
+	void* mem = mmap(NULL, MAPPING_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (mem == MAP_FAILED) {
+		perror("mmap");
+		return NULL;
+	}
+	return (char*) mem;
+}
+
+static struct pru_ring* header(char* mem) {
+	return (struct pru_ring*) mem;
+}
+
+/* Producer as the firmware does it, one element at a time */
+static void produce(char* mem, uint32_t value) {
+	struct pru_ring* r = header(mem);
+	uint32_t head = r->head;
+	memcpy(mem + PRU_RING_DATA + (head & (r->capacity - 1)) * r->elem_size, &value, sizeof(value));
+	r->head = head + 1;
+}
+
+/* head and tail are free-running, so they wrap past 0xFFFFFFFF mid-ring */
+static void testWraparound(char* mem) {
+	RingBuffer ring;
+	uint32_t out[4];
+	bool wasEmpty;
+
+	RingBuffer::format(mem, 4, 4);
+	header(mem)->head = header(mem)->tail = 0xFFFFFFFE;
+	CHECK(ring.attach(mem, RingBuffer::footprint(4, 4)));
+
+	for (uint32_t i = 0; i < 3; i++) {
+		produce(mem, 100 + i);
+	}
+	CHECK(header(mem)->head == 1);
+	CHECK(ring.available() == 3);
+	CHECK(ring.space() == 1);
+
+	CHECK(ring.read(out, 4) == 3);
+	CHECK(out[0] == 100 && out[1] == 101 && out[2] == 102);
+	CHECK(header(mem)->tail == 1);
+	CHECK(ring.available() == 0);
+
+	//Host as the producer, across the same wrap
+	header(mem)->head = header(mem)->tail = 0xFFFFFFFF;
+	uint32_t in[4] = { 1, 2, 3, 4 };
+	CHECK(ring.write(in, 4, &wasEmpty) == 4);
+	CHECK(wasEmpty);
+	CHECK(header(mem)->head == 3);
+	CHECK(ring.space() == 0);
+	CHECK(ring.write(in, 1, &wasEmpty) == 0);
+	CHECK(ring.read(out, 4) == 4);
+	CHECK(out[0] == 1 && out[1] == 2 && out[2] == 3 && out[3] == 4);
+}
+
+/* read() takes at most maxItems, and what is left stays for the next call */
+static void testBatching(char* mem) {
+	RingBuffer ring;
+	uint32_t out[8];
+
+	RingBuffer::format(mem, 8, 4);
+	CHECK(ring.attach(mem, RingBuffer::footprint(8, 4)));
+	CHECK(ring.read(out, 8) == 0);
+
+	for (uint32_t i = 0; i < 7; i++) {
+		produce(mem, i);
+	}
+	CHECK(ring.read(out, 3) == 3);
+	CHECK(out[0] == 0 && out[2] == 2);
+	CHECK(ring.available() == 4);
+	CHECK(ring.read(out, 3) == 3);
+	CHECK(out[0] == 3 && out[2] == 5);
+	CHECK(ring.read(out, 3) == 1);
+	CHECK(out[0] == 6);
+	CHECK(ring.read(out, 3) == 0);
+
+	//A head too far ahead is reported, and nothing is copied
+	header(mem)->head = header(mem)->tail + 9;
+	CHECK(ring.available() == 9);
+	CHECK(ring.read(out, 8) == 0);
+}
+
+/* Headers that don't describe a ring fitting the region are refused */
+static void testRejectedHeaders(char* mem) {
+	RingBuffer ring;
+
+	RingBuffer::format(mem, 3, 4);
+	CHECK(!ring.attach(mem, MAPPING_SIZE));
+	RingBuffer::format(mem, 0, 4);
+	CHECK(!ring.attach(mem, MAPPING_SIZE));
+	RingBuffer::format(mem, 4, 6);
+	CHECK(!ring.attach(mem, MAPPING_SIZE));
+	RingBuffer::format(mem, 4, 0);
+	CHECK(!ring.attach(mem, MAPPING_SIZE));
+
+	RingBuffer::format(mem, 16, 8);
+	CHECK(!ring.attach(mem, RingBuffer::footprint(16, 8) - 1));
+	CHECK(ring.attach(mem, RingBuffer::footprint(16, 8)));
+
+	//Would overflow 32 bits
+	RingBuffer::format(mem, 0x80000000, 0x100);
+	CHECK(RingBuffer::footprint(0x80000000, 0x100) > 0xFFFFFFFFULL);
+	CHECK(!ring.attach(mem, MAPPING_SIZE));
+}
+
+/* The geometry is taken once, a header rewritten later can't push copies past the ring */
+static void testSnapshot(char* mem) {
+	RingBuffer ring;
+	uint32_t out[4];
+	uint32_t in[8] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+	bool wasEmpty;
+	size_t footprint = RingBuffer::footprint(4, 4);
+	uint32_t canary = 0xDEADBEEF;
+
+	memset(mem, 0, MAPPING_SIZE);
+	RingBuffer::format(mem, 4, 4);
+	memcpy(mem + footprint, &canary, sizeof(canary));
+	CHECK(ring.attach(mem, footprint));
+
+	header(mem)->capacity = 1024;
+	header(mem)->elem_size = 64;
+	CHECK(ring.capacity() == 4);
+	CHECK(ring.elementSize() == 4);
+
+	CHECK(ring.write(in, 8, &wasEmpty) == 4);
+	CHECK(ring.space() == 0);
+	CHECK(memcmp(mem + footprint, &canary, sizeof(canary)) == 0);
+
+	CHECK(ring.read(out, 4) == 4);
+	CHECK(out[0] == 1 && out[3] == 4);
+	CHECK(header(mem)->tail == 4);
+}
+
+int main() {
+	char* mem = mapMemory();
+	if (mem == NULL) {
+		return 1;
+	}
+
+	testWraparound(mem);
+	testBatching(mem);
+	testRejectedHeaders(mem);
+	testSnapshot(mem);
+
+	munmap(mem, MAPPING_SIZE);
+	if (failures != 0) {
+		fprintf(stderr, "%d check(s) failed\n", failures);
+		return 1;
+	}
+	printf("ok\n");
+	return 0;
+}